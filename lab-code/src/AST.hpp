@@ -1,26 +1,44 @@
 #pragma once
 #include <string>
-#include <memory>
+#include <string_view>
 #include <iostream>
 #include <vector>
+#include "arena.hpp"
 
-// 所有 AST 的基类
+// 一次 Koopa IR 生成的状态: 当前函数已生成的指令和临时变量 / 标号编号,
+// 每次编译各用一个, 互不影响
+struct KoopaContext {
+  std::vector<std::string> code;
+  int tmp_id = 0;
+  int label_id = 0;
+  std::string NewTemp() { return "%" + std::to_string(tmp_id++); }
+};
+
+// 所有 AST 的基类. 结点都分配在解析用的 Arena 中, 不单独析构,
+// 所以子结点是普通指针, 文本是指向 Arena 或字面量的 string_view
 class BaseAST {
  public:
-  virtual ~BaseAST() = default;
-  virtual void Dump() const = 0;
-  virtual std::string EmitKoopa(std::vector<std::string>& code) const = 0;
+  virtual void Dump(std::ostream& out) const = 0;
+  virtual std::string EmitKoopa(KoopaContext& ctx) const = 0;
+  // 求值代价的粗略估计, 用于决定 && / || 是否生成分支
+  virtual int Cost() const { return 0; }
+  // 求值是否可能出错 (如除零), 这样的右操作数必须短路求值
+  virtual bool MayTrap() const { return false; }
+
+ protected:
+  ~BaseAST() = default;
 };
 
-inline int koopa_tmp_id = 0;
+// 右操作数代价不超过该值且不会出错时, && / || 不生成分支
+inline constexpr int kShortCircuitCost = 2;
 
 class NumberAST : public BaseAST {
 public:
     int value;
-    void Dump() const override {
-        std::cout << value;
+    void Dump(std::ostream& out) const override {
+        out << value;
     }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
+    std::string EmitKoopa(KoopaContext& ctx) const override {
         return std::to_string(value);
     }
 };
@@ -28,65 +46,80 @@ public:
 class PrimaryExpAST : public BaseAST {
 public:
     bool is_number = false;
-    std::unique_ptr<BaseAST> exp;
+    const BaseAST *exp = nullptr;
     int number_value = 0;
-    void Dump() const override {
+    void Dump(std::ostream& out) const override {
         if (is_number) {
-            std::cout << number_value;
+            out << number_value;
         } else {
-            std::cout << "(";
-            exp->Dump();
-            std::cout << ")";
+            out << "(";
+            exp->Dump(out);
+            out << ")";
         }
     }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
+    std::string EmitKoopa(KoopaContext& ctx) const override {
         if (is_number) {
             return std::to_string(number_value);
         } else {
-            return exp->EmitKoopa(code);
+            return exp->EmitKoopa(ctx);
         }
     }
+    int Cost() const override {
+        return is_number ? 0 : exp->Cost();
+    }
+    bool MayTrap() const override {
+        return !is_number && exp->MayTrap();
+    }
 };
 
 class UnaryExpAST : public BaseAST {
 public:
-    std::string op;
-    std::unique_ptr<BaseAST> exp;
-    void Dump() const override {
-        std::cout << op << " ";
-        exp->Dump();
-    }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
-        std::string val = exp->EmitKoopa(code);
+    std::string_view op;
+    const BaseAST *exp = nullptr;
+    void Dump(std::ostream& out) const override {
+        out << op << " ";
+        exp->Dump(out);
+    }
+    std::string EmitKoopa(KoopaContext& ctx) const override {
+        std::string val = exp->EmitKoopa(ctx);
         if (op == "+") {
             return val;
         } else if (op == "-") {
-            std::string res = "%" + std::to_string(koopa_tmp_id++);
-            code.push_back(res + " = sub 0, " + val);
+            std::string res = ctx.NewTemp();
+            ctx.code.push_back(res + " = sub 0, " + val);
             return res;
         } else if (op == "!") {
-            std::string res = "%" + std::to_string(koopa_tmp_id++);
-            code.push_back(res + " = eq " + val + ", 0");
+            std::string res = ctx.NewTemp();
+            ctx.code.push_back(res + " = eq " + val + ", 0");
             return res;
         }
         return val;
     }
+    int Cost() const override {
+        return (op == "+" ? 0 : 1) + exp->Cost();
+    }
+    bool MayTrap() const override {
+        return exp->MayTrap();
+    }
 };
 
 class BinaryExpAST : public BaseAST {
 public:
-    std::string op;
-    std::unique_ptr<BaseAST> lhs;
-    std::unique_ptr<BaseAST> rhs;
-    void Dump() const override {
-        lhs->Dump();
-        std::cout << " " << op << " ";
-        rhs->Dump();
-    }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
-        std::string l = lhs->EmitKoopa(code);
-        std::string r = rhs->EmitKoopa(code);
-        std::string res = "%" + std::to_string(koopa_tmp_id++);
+    std::string_view op;
+    const BaseAST *lhs = nullptr;
+    const BaseAST *rhs = nullptr;
+    void Dump(std::ostream& out) const override {
+        lhs->Dump(out);
+        out << " " << op << " ";
+        rhs->Dump(out);
+    }
+    std::string EmitKoopa(KoopaContext& ctx) const override {
+        if (op == "&&" || op == "||") {
+            return EmitLogical(ctx);
+        }
+        std::string l = lhs->EmitKoopa(ctx);
+        std::string r = rhs->EmitKoopa(ctx);
+        std::string res = ctx.NewTemp();
         std::string koopa_op;
         if (op == "+") koopa_op = "add";
         else if (op == "-") koopa_op = "sub";
@@ -99,83 +132,144 @@ public:
         else if (op == ">=") koopa_op = "ge";
         else if (op == "==") koopa_op = "eq";
         else if (op == "!=") koopa_op = "ne";
-        else if (op == "&&") koopa_op = "and";
-        else if (op == "||") koopa_op = "or";
         else koopa_op = op;
-        code.push_back(res + " = " + koopa_op + " " + l + ", " + r);
+        ctx.code.push_back(res + " = " + koopa_op + " " + l + ", " + r);
+        return res;
+    }
+    int Cost() const override {
+        int self = (op == "/" || op == "%") ? 4 : 1;
+        return self + lhs->Cost() + rhs->Cost();
+    }
+    bool MayTrap() const override {
+        return op == "/" || op == "%" || lhs->MayTrap() || rhs->MayTrap();
+    }
+
+private:
+    // && / ||: 右操作数便宜且不会出错时用 ne/and/or 直接算出 0/1,
+    // 否则先把短路结果存入临时变量, 只在需要时跳转去求右操作数
+    std::string EmitLogical(KoopaContext& ctx) const {
+        bool is_and = op == "&&";
+        if (!rhs->MayTrap() && rhs->Cost() <= kShortCircuitCost) {
+            std::string l = lhs->EmitKoopa(ctx);
+            std::string r = rhs->EmitKoopa(ctx);
+            if (is_and) {
+                std::string lb = ctx.NewTemp();
+                ctx.code.push_back(lb + " = ne " + l + ", 0");
+                std::string rb = ctx.NewTemp();
+                ctx.code.push_back(rb + " = ne " + r + ", 0");
+                std::string res = ctx.NewTemp();
+                ctx.code.push_back(res + " = and " + lb + ", " + rb);
+                return res;
+            }
+            std::string any = ctx.NewTemp();
+            ctx.code.push_back(any + " = or " + l + ", " + r);
+            std::string res = ctx.NewTemp();
+            ctx.code.push_back(res + " = ne " + any + ", 0");
+            return res;
+        }
+
+        std::string id = std::to_string(ctx.label_id++);
+        std::string prefix = is_and ? "%and_" : "%or_";
+        std::string result = prefix + "res_" + id;
+        std::string rhs_bb = prefix + "rhs_" + id;
+        std::string end_bb = prefix + "end_" + id;
+        ctx.code.push_back(result + " = alloc i32");
+        ctx.code.push_back(std::string("store ") + (is_and ? "0" : "1") + ", " + result);
+        std::string l = lhs->EmitKoopa(ctx);
+        if (is_and) {
+            ctx.code.push_back("br " + l + ", " + rhs_bb + ", " + end_bb);
+        } else {
+            ctx.code.push_back("br " + l + ", " + end_bb + ", " + rhs_bb);
+        }
+        ctx.code.push_back(rhs_bb + ":");
+        std::string r = rhs->EmitKoopa(ctx);
+        std::string rb = ctx.NewTemp();
+        ctx.code.push_back(rb + " = ne " + r + ", 0");
+        ctx.code.push_back("store " + rb + ", " + result);
+        ctx.code.push_back("jump " + end_bb);
+        ctx.code.push_back(end_bb + ":");
+        std::string res = ctx.NewTemp();
+        ctx.code.push_back(res + " = load " + result);
         return res;
     }
 };
 
 class ExpAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> lor_exp;
-    void Dump() const override {
-        lor_exp->Dump();
+    const BaseAST *lor_exp = nullptr;
+    void Dump(std::ostream& out) const override {
+        lor_exp->Dump(out);
+    }
+    std::string EmitKoopa(KoopaContext& ctx) const override {
+        return lor_exp->EmitKoopa(ctx);
+    }
+    int Cost() const override {
+        return lor_exp->Cost();
     }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
-        return lor_exp->EmitKoopa(code);
+    bool MayTrap() const override {
+        return lor_exp->MayTrap();
     }
 };
 
 class StmtAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> stmt;
-    void Dump() const override {
-        std::cout << "return ";
-        stmt->Dump();
-        std::cout << ";" << std::endl;
-    }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
-        std::string val = stmt->EmitKoopa(code);
-        code.push_back("ret " + val);
+    const BaseAST *stmt = nullptr;
+    void Dump(std::ostream& out) const override {
+        out << "return ";
+        stmt->Dump(out);
+        out << ";" << std::endl;
+    }
+    std::string EmitKoopa(KoopaContext& ctx) const override {
+        std::string val = stmt->EmitKoopa(ctx);
+        ctx.code.push_back("ret " + val);
         return "";
     }
 };
 
 class BlockAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> stmt;
-    void Dump() const override {
-        std::cout << "{ ";
-        stmt->Dump();
-        std::cout << " }" << std::endl;
-    }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
-        code.push_back("%entry:");
-        stmt->EmitKoopa(code);
+    const BaseAST *stmt = nullptr;
+    void Dump(std::ostream& out) const override {
+        out << "{ ";
+        stmt->Dump(out);
+        out << " }" << std::endl;
+    }
+    std::string EmitKoopa(KoopaContext& ctx) const override {
+        ctx.code.push_back("%entry:");
+        stmt->EmitKoopa(ctx);
         return "";
     }
 };
 
 class FuncTypeAST : public BaseAST {
 public:
-    std::string type;
-    void Dump() const override {
-        std::cout << type << " ";
+    std::string_view type;
+    void Dump(std::ostream& out) const override {
+        out << type << " ";
     }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
+    std::string EmitKoopa(KoopaContext& ctx) const override {
         return "i32 ";
     }
 };
 
 class FuncDefAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> func_type;
-    std::string ident;
-    std::unique_ptr<BaseAST> block;
-    void Dump() const override {
-        func_type->Dump();
-        std::cout << ident << "() ";
-        block->Dump();
-    }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
-        koopa_tmp_id = 0;
-        code.clear();
+    const BaseAST *func_type = nullptr;
+    std::string_view ident;
+    const BaseAST *block = nullptr;
+    void Dump(std::ostream& out) const override {
+        func_type->Dump(out);
+        out << ident << "() ";
+        block->Dump(out);
+    }
+    std::string EmitKoopa(KoopaContext& ctx) const override {
+        ctx.tmp_id = 0;
+        ctx.label_id = 0;
+        ctx.code.clear();
         std::string koopa;
-        koopa += "fun @" + ident + "(): " + func_type->EmitKoopa(code) + "{\n";
-        block->EmitKoopa(code);
-        for (auto& line : code) {
+        koopa += "fun @" + std::string(ident) + "(): " + func_type->EmitKoopa(ctx) + "{\n";
+        block->EmitKoopa(ctx);
+        for (auto& line : ctx.code) {
             koopa += "  " + line + "\n";
         }
         koopa += "}\n";
@@ -185,11 +279,19 @@ public:
 
 class CompUnitAST : public BaseAST {
 public:
-    std::unique_ptr<BaseAST> func_def;
-    void Dump() const override {
-        func_def->Dump();
+    // 按出现顺序排列的函数定义
+    ArenaArray<const BaseAST *> func_defs;
+    void Dump(std::ostream& out) const override {
+        for (auto& func_def : func_defs) {
+            func_def->Dump(out);
+        }
     }
-    std::string EmitKoopa(std::vector<std::string>& code) const override {
-        return func_def->EmitKoopa(code);
+    std::string EmitKoopa(KoopaContext& ctx) const override {
+        std::string koopa;
+        for (size_t i = 0; i < func_defs.size(); ++i) {
+            if (i > 0) koopa += "\n";
+            koopa += func_defs[i]->EmitKoopa(ctx);
+        }
+        return koopa;
     }
 };
\ No newline at end of file
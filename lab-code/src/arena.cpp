@@ -0,0 +1,38 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+void *Arena::Allocate(size_t size, size_t align) {
+  auto aligned = [&](char *p) {
+    return reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(p) + align - 1) & ~uintptr_t(align - 1));
+  };
+  char *p = aligned(cur_);
+  // 对齐后可能已经越过 end_, 先比较指针再求剩余空间
+  if (!cur_ || p > end_ || size > size_t(end_ - p)) {
+    // 超过一块大小的对象单独占一块
+    size_t chunk_size = std::max(kChunkSize, size + align);
+    chunks_.push_back(
+        Chunk{std::unique_ptr<char[]>(new char[chunk_size]), chunk_size});
+    cur_ = chunks_.back().data.get();
+    end_ = cur_ + chunk_size;
+    p = aligned(cur_);
+  }
+  cur_ = p + size;
+  return p;
+}
+
+std::string_view Arena::CopyString(std::string_view text) {
+  if (text.empty()) return {};
+  auto *data = static_cast<char *>(Allocate(text.size(), 1));
+  memcpy(data, text.data(), text.size());
+  return {data, text.size()};
+}
+
+void Arena::Reset() {
+  if (chunks_.empty()) return;
+  chunks_.resize(1);
+  cur_ = chunks_[0].data.get();
+  end_ = cur_ + chunks_[0].size;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 分配在 Arena 中的定长数组
+template <class T>
+class ArenaArray {
+ public:
+  ArenaArray() = default;
+  ArenaArray(const T *data, size_t size) : data_(data), size_(size) {}
+
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+  const T &operator[](size_t i) const { return data_[i]; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  const T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// 一次编译的 bump-pointer 分配器: AST 结点和标识符文本都放在这里, 不逐个
+// 析构, 随 Reset 或 Arena 本身一次释放, 因此只能放平凡析构的对象
+class Arena {
+ public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  template <class T, class... Args>
+  T *New(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena objects are never destroyed");
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // 复制 items, 结果在 Reset 之前有效
+  template <class T>
+  ArenaArray<T> CopyArray(const std::vector<T> &items) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (items.empty()) return {};
+    auto *data = static_cast<T *>(Allocate(sizeof(T) * items.size(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), data);
+    return {data, items.size()};
+  }
+
+  // 复制一段文本, 结果在 Reset 之前有效
+  std::string_view CopyString(std::string_view text);
+
+  void *Allocate(size_t size, size_t align);
+  // 释放所有对象, 保留第一块内存给之后的分配
+  void Reset();
+
+ private:
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  static constexpr size_t kChunkSize = size_t(64) << 10;
+
+  std::vector<Chunk> chunks_;
+  char *cur_ = nullptr;
+  char *end_ = nullptr;
+};
@@ -0,0 +1,102 @@
+#include "batch.hpp"
+#include <exception>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include "thread_pool.hpp"
+
+namespace {
+
+// a/b/c.sy => c
+std::string Stem(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  size_t dot = name.find_last_of('.');
+  return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+void WriteFile(const std::string &path, const std::string &content,
+               std::vector<std::string> &errors) {
+  std::ofstream out(path, std::ios::out | std::ios::trunc);
+  out << content;
+  if (!out) errors.push_back("cannot write " + path);
+}
+
+// 编译一个文件, 失败原因写入 errors
+void CompileFile(const BatchOptions &opts, const std::string &input,
+                 const std::string &output, std::vector<std::string> &errors) {
+  SourceBuffer src;
+  std::string error;
+  // 不用 mmap: 编译期间输入被截断会让整个进程收到 SIGBUS
+  if (!src.Read(input, opts.max_source_size, error)) {
+    errors.push_back(error);
+    return;
+  }
+  StringSink sink, koopa;
+  CompileOptions compile_opts = opts.compile;
+  if (!opts.koopa_dir.empty()) compile_opts.koopa_sink = &koopa;
+  try {
+    if (!compile(src, compile_opts, sink)) {
+      errors = std::move(sink.errors);
+      return;
+    }
+  } catch (const std::exception &e) {
+    errors.push_back(e.what());
+    return;
+  }
+  WriteFile(output, sink.output, errors);
+  if (!opts.koopa_dir.empty())
+    WriteFile(opts.koopa_dir + "/" + Stem(input) + ".koopa", koopa.output,
+              errors);
+}
+
+}  // namespace
+
+bool ReadManifest(const std::string &path, std::vector<std::string> &inputs,
+                  std::string &error) {
+  std::ifstream in(path);
+  if (!in) {
+    error = "cannot open manifest '" + path + "'";
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+      line.pop_back();
+    if (!line.empty() && line[0] != '#') inputs.push_back(line);
+  }
+  return true;
+}
+
+int RunBatch(const BatchOptions &opts, std::ostream &err) {
+  const char *ext = opts.compile.output == OutputKind::Koopa ? ".koopa" : ".s";
+  std::vector<std::string> outputs;
+  std::vector<std::vector<std::string>> errors(opts.inputs.size());
+  std::map<std::string, size_t> owner;
+  for (size_t i = 0; i < opts.inputs.size(); ++i) {
+    outputs.push_back(opts.output_dir + "/" + Stem(opts.inputs[i]) + ext);
+    auto [it, fresh] = owner.emplace(outputs[i], i);
+    if (!fresh)
+      errors[i].push_back("output " + outputs[i] + " already produced by " +
+                          opts.inputs[it->second]);
+  }
+
+  {
+    ThreadPool pool(opts.jobs);
+    for (size_t i = 0; i < opts.inputs.size(); ++i)
+      if (errors[i].empty())
+        pool.Submit([&, i] {
+          CompileFile(opts, opts.inputs[i], outputs[i], errors[i]);
+        });
+    pool.Wait();
+  }
+
+  int failed = 0;
+  for (size_t i = 0; i < opts.inputs.size(); ++i) {
+    if (errors[i].empty()) continue;
+    ++failed;
+    for (const auto &e : errors[i])
+      err << opts.inputs[i] << ": error: " << e << "\n";
+  }
+  return failed;
+}
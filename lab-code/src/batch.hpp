@@ -0,0 +1,26 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "sysyc.hpp"
+
+// 批量编译: 在一个进程内用线程池编译多个源文件
+struct BatchOptions {
+  CompileOptions compile;
+  std::vector<std::string> inputs;
+  std::string output_dir;
+  // compile.output 为 RiscV 时, 非空则把同一次解析生成的 Koopa IR
+  // 同时写到 koopa_dir/<去掉扩展名的文件名>.koopa
+  std::string koopa_dir;
+  int jobs = 1;
+  // 单个源文件的大小上限, 每个工作线程同时只持有一个文件的源码和输出
+  size_t max_source_size = size_t(64) << 20;
+};
+
+// 读取清单文件: 每行一个源文件路径, 忽略空行和 # 开头的行
+bool ReadManifest(const std::string &path, std::vector<std::string> &inputs,
+                  std::string &error);
+
+// 编译所有输入, 结果写到 output_dir/<去掉扩展名的文件名>.koopa 或 .s.
+// 单个文件失败不影响其他文件, 诊断按输入顺序写到 err. 返回失败的文件数
+int RunBatch(const BatchOptions &opts, std::ostream &err);
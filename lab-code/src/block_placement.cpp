@@ -0,0 +1,171 @@
+#include "block_placement.hpp"
+#include <algorithm>
+#include <cassert>
+#include <set>
+
+namespace {
+
+// Ball & Larus 的经验概率
+constexpr double kLoopBranchProb = 0.88;
+constexpr double kReturnProb = 0.28;
+
+// 两条启发式给出的概率合并 (Dempster-Shafer)
+double Combine(double p, double q) {
+  return p * q / (p * q + (1 - p) * (1 - q));
+}
+
+std::vector<bool> Reachable(const MachineFunction &mf) {
+  std::vector<bool> seen(mf.blocks.size(), false);
+  std::vector<int> work{0};
+  seen[0] = true;
+  while (!work.empty()) {
+    int b = work.back();
+    work.pop_back();
+    for (int s : mf.Successors(b))
+      if (!seen[s]) seen[s] = true, work.push_back(s);
+  }
+  return seen;
+}
+
+// 每个块所在的自然循环 (用循环头编号), 由 dom[b] 判断回边
+std::vector<std::set<int>> FindLoops(const MachineFunction &mf,
+                                     const std::vector<bool> &reachable) {
+  int n = int(mf.blocks.size());
+  std::vector<std::vector<int>> preds(n);
+  for (int b = 0; b < n; ++b)
+    if (reachable[b])
+      for (int s : mf.Successors(b)) preds[s].push_back(b);
+
+  // 迭代求支配集合
+  std::vector<std::set<int>> dom(n);
+  std::set<int> all;
+  for (int b = 0; b < n; ++b)
+    if (reachable[b]) all.insert(b);
+  for (int b = 0; b < n; ++b) dom[b] = b == 0 ? std::set<int>{0} : all;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int b = 1; b < n; ++b) {
+      if (!reachable[b]) continue;
+      std::set<int> d = all;
+      for (int p : preds[b]) {
+        std::set<int> meet;
+        std::set_intersection(d.begin(), d.end(), dom[p].begin(), dom[p].end(),
+                              std::inserter(meet, meet.begin()));
+        d = std::move(meet);
+      }
+      d.insert(b);
+      if (d != dom[b]) dom[b] = std::move(d), changed = true;
+    }
+  }
+
+  std::vector<std::set<int>> loops(n);
+  for (int b = 0; b < n; ++b) {
+    if (!reachable[b]) continue;
+    for (int h : mf.Successors(b)) {
+      if (!dom[b].count(h)) continue;
+      // 回边 b -> h: 从 b 逆向走到 h 得到循环体
+      std::vector<int> work{b};
+      std::set<int> body{h};
+      while (!work.empty()) {
+        int x = work.back();
+        work.pop_back();
+        if (!body.insert(x).second) continue;
+        for (int p : preds[x]) work.push_back(p);
+      }
+      for (int x : body) loops[x].insert(h);
+    }
+  }
+  return loops;
+}
+
+// 条件分支跳向 target 的概率, other 为不跳转时去的块
+double TakenProbability(const MachineFunction &mf,
+                        const std::vector<std::set<int>> &loops, int b,
+                        int target, int other) {
+  double p = 0.5;
+  // 循环分支: 留在循环内的一边更可能
+  auto stays = [&](int s) {
+    return std::includes(loops[s].begin(), loops[s].end(), loops[b].begin(),
+                         loops[b].end());
+  };
+  if (stays(target) != stays(other))
+    p = Combine(p, stays(target) ? kLoopBranchProb : 1 - kLoopBranchProb);
+  // 返回分支: 直接返回的一边多为提前退出或出错路径
+  auto returns = [&](int s) {
+    const auto &insts = mf.blocks[s].insts;
+    return !insts.empty() && insts.back().op == MOpcode::RET;
+  };
+  if (returns(target) != returns(other))
+    p = Combine(p, returns(target) ? kReturnProb : 1 - kReturnProb);
+  return p;
+}
+
+}  // namespace
+
+void PlaceBlocks(MachineFunction &mf) {
+  int n = int(mf.blocks.size());
+  auto reachable = Reachable(mf);
+  auto loops = FindLoops(mf, reachable);
+
+  // 每个块按可能性从高到低排列的后继
+  std::vector<std::vector<int>> likely(n);
+  for (int b = 0; b < n; ++b) {
+    if (!reachable[b]) continue;
+    const auto &insts = mf.blocks[b].insts;
+    size_t k = insts.size();
+    if (k >= 2 && insts[k - 2].format() == MFormat::Branch &&
+        insts[k - 1].op == MOpcode::J) {
+      int t = insts[k - 2].target, f = insts[k - 1].target;
+      double p = TakenProbability(mf, loops, b, t, f);
+      // 概率相同时保持原有顺序
+      if (p > 0.5 || (p == 0.5 && t < f))
+        likely[b] = {t, f};
+      else
+        likely[b] = {f, t};
+    } else {
+      likely[b] = mf.Successors(b);
+    }
+  }
+
+  // 贪心成链: 当前块之后放它最可能且尚未放置的后继
+  std::vector<int> order;
+  std::vector<bool> placed(n, false);
+  for (int start = 0; start < n; ++start) {
+    int b = start;
+    while (b >= 0 && reachable[b] && !placed[b]) {
+      placed[b] = true;
+      order.push_back(b);
+      int next = -1;
+      for (int s : likely[b])
+        if (!placed[s]) {
+          next = s;
+          break;
+        }
+      b = next;
+    }
+  }
+
+  std::vector<int> new_index(n, -1);
+  for (int i = 0; i < int(order.size()); ++i) new_index[order[i]] = i;
+  std::vector<MachineBasicBlock> blocks;
+  for (int b : order) {
+    blocks.push_back(std::move(mf.blocks[b]));
+    for (auto &inst : blocks.back().insts)
+      if (inst.target >= 0) inst.target = new_index[inst.target];
+  }
+  mf.blocks = std::move(blocks);
+
+  // 条件分支的目标恰好是下一个块时反转条件, 让它直接落下去
+  for (int b = 0; b + 1 < int(mf.blocks.size()); ++b) {
+    auto &insts = mf.blocks[b].insts;
+    size_t k = insts.size();
+    if (k < 2 || insts[k - 2].format() != MFormat::Branch ||
+        insts[k - 1].op != MOpcode::J || insts[k - 2].target != b + 1)
+      continue;
+    auto &br = insts[k - 2];
+    br.op = br.op == MOpcode::BNEZ ? MOpcode::BEQZ : MOpcode::BNEZ;
+    br.target = insts[k - 1].target;
+    insts.pop_back();
+  }
+}
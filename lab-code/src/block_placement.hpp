@@ -0,0 +1,8 @@
+#pragma once
+#include "mir.hpp"
+
+// 静态块布局: 删除不可达块, 用循环结构和启发式估计分支概率
+// (回边多半跳转, 离开循环和直接返回的路径偏冷), 把更可能的后继排在
+// 紧随其后的位置, 必要时反转条件分支. 需在指令选择之后、
+// 寄存器分配之前调用, 此时每个块都以显式的跳转结尾.
+void PlaceBlocks(MachineFunction &mf);
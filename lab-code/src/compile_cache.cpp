@@ -0,0 +1,166 @@
+#include "compile_cache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "sha256.hpp"
+// 由 Makefile 生成, 定义 SYSYC_BUILD_ID
+#include "build_id.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 缓存内容格式变化时修改, 使旧缓存失效
+const char kCacheFormat[] = "sysyc-cache-1";
+// 记录缓存总大小的文件, 同时作为更新总大小时的锁
+const char kSizeFile[] = "size";
+// 写入中的临时文件的前缀
+const char kTmpPrefix[] = "tmp.";
+
+// 编译器本身的标识: 源文件和编译命令的哈希, 重新构建后旧的缓存自然失效.
+// 编进 libsysyc, 与嵌入它的可执行文件无关
+const char kBuildId[] = SYSYC_BUILD_ID;
+
+}  // namespace
+
+CompileCache::CompileCache(std::string dir, uint64_t max_bytes)
+    : dir_(std::move(dir)), max_bytes_(max_bytes) {}
+
+std::string CompileCache::Key(const char *src, size_t len,
+                              const CompileOptions &opts) const {
+  return Hash("program", src, len, opts);
+}
+
+std::string CompileCache::FragmentKey(const std::string &text,
+                                      const CompileOptions &opts) const {
+  return Hash("function", text.data(), text.size(), opts);
+}
+
+std::string CompileCache::Hash(const char *kind, const char *data, size_t len,
+                               const CompileOptions &opts) const {
+  const auto &backend = opts.backend;
+  std::ostringstream header;
+  header << kCacheFormat << '\n'
+         << kBuildId << '\n'
+         << kind << '\n'
+         << (opts.output == OutputKind::Koopa ? "koopa" : "riscv") << '\n'
+         << backend.core->name << '\n'
+         << "rv" << backend.features.xlen << " zbb=" << backend.features.zbb
+         << " zicond=" << backend.features.zicond << '\n'
+         << len << '\n';
+  Sha256 hash;
+  hash.Update(header.str());
+  hash.Update(data, len);
+  return hash.HexDigest();
+}
+
+std::string CompileCache::PathOf(const std::string &key) const {
+  return dir_ + "/" + key.substr(0, 2) + "/" + key;
+}
+
+bool CompileCache::Lookup(const std::string &key, std::string &output) const {
+  std::string path = PathOf(key);
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  std::stringstream content;
+  content << in.rdbuf();
+  output = content.str();
+  // 刷新修改时间, 作为 LRU 淘汰的依据
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return true;
+}
+
+void CompileCache::Insert(const std::string &key,
+                          const std::string &output) const {
+  static std::atomic<unsigned> counter{0};
+  std::error_code ec;
+  std::string path = PathOf(key);
+  fs::create_directories(fs::path(path).parent_path(), ec);
+  if (ec) return;
+  std::string tmp = dir_ + "/" + kTmpPrefix + std::to_string(getpid()) + "." +
+                    std::to_string(std::hash<std::thread::id>()(
+                        std::this_thread::get_id())) +
+                    "." + std::to_string(counter++);
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out << output;
+    if (!out) {
+      fs::remove(tmp, ec);
+      return;
+    }
+  }
+  // 覆盖已有的条目时只记大小之差
+  uint64_t replaced = fs::file_size(path, ec);
+  if (ec) replaced = 0;
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return;
+  }
+  AddSize(int64_t(output.size()) - int64_t(replaced));
+}
+
+void CompileCache::AddSize(int64_t delta) const {
+  int fd = open((dir_ + "/" + kSizeFile).c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return;
+  flock(fd, LOCK_EX);
+  char buf[32];
+  ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+  uint64_t total;
+  if (n > 0) {
+    buf[n] = '\0';
+    int64_t updated = int64_t(strtoull(buf, nullptr, 10)) + delta;
+    total = updated > 0 ? uint64_t(updated) : 0;
+    if (total > max_bytes_) total = Evict();
+  } else {
+    // 还没有记录时扫描一遍得到实际大小
+    total = Evict();
+  }
+  std::string text = std::to_string(total);
+  if (ftruncate(fd, 0) == 0) pwrite(fd, text.data(), text.size(), 0);
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+uint64_t CompileCache::Evict() const {
+  struct Entry {
+    fs::file_time_type mtime;
+    uint64_t size;
+    fs::path path;
+  };
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  std::error_code ec;
+  for (fs::recursive_directory_iterator it(dir_, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (!it->is_regular_file(ec)) continue;
+    // 其他进程正在写的临时文件和大小文件本身不计入, 也不删除
+    auto name = it->path().filename().string();
+    if (name == kSizeFile || name.rfind(kTmpPrefix, 0) == 0) continue;
+    Entry e{it->last_write_time(ec), it->file_size(ec), it->path()};
+    if (ec) continue;
+    total += e.size;
+    entries.push_back(std::move(e));
+  }
+  if (total <= max_bytes_) return total;
+  // 删到上限的 90%, 免得每次写入都要淘汰
+  std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+    return std::tie(a.mtime, a.path) < std::tie(b.mtime, b.path);
+  });
+  uint64_t target = max_bytes_ / 10 * 9;
+  for (const auto &e : entries) {
+    if (total <= target) break;
+    if (fs::remove(e.path, ec)) total -= e.size;
+  }
+  return total;
+}
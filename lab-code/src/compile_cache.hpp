@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "sysyc.hpp"
+
+// 内容寻址的编译缓存. 键是 (源码, 输出种类, 后端选项, 编译器构建) 的
+// SHA-256, 输出存放在 dir/<键的前两位>/<键>. 写入时先写临时文件再 rename,
+// 多个进程或线程共用一个目录也不会读到写了一半的内容. 总大小记录在
+// dir/size 中, 每次写入只更新它; 超过上限时才扫描目录, 按最近使用时间
+// 淘汰, 命中会刷新文件的修改时间.
+class CompileCache {
+ public:
+  CompileCache(std::string dir, uint64_t max_bytes);
+
+  // 整个源程序的键
+  std::string Key(const char *src, size_t len, const CompileOptions &opts) const;
+  // 单个函数输出片段的键, text 为函数 AST 的规范文本
+  std::string FragmentKey(const std::string &text,
+                          const CompileOptions &opts) const;
+  // 命中时把输出写入 output 并返回 true
+  bool Lookup(const std::string &key, std::string &output) const;
+  void Insert(const std::string &key, const std::string &output) const;
+
+ private:
+  std::string Hash(const char *kind, const char *data, size_t len,
+                   const CompileOptions &opts) const;
+  std::string PathOf(const std::string &key) const;
+  // 在 dir/size 的锁内把总大小加上 delta, 超过上限时淘汰
+  void AddSize(int64_t delta) const;
+  // 扫描缓存目录, 超过上限时淘汰最久未用的条目, 返回剩余的总大小
+  uint64_t Evict() const;
+
+  std::string dir_;
+  uint64_t max_bytes_;
+};
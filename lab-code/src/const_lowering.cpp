@@ -0,0 +1,121 @@
+#include "const_lowering.hpp"
+#include "target.hpp"
+#include <map>
+
+namespace {
+
+// c = (hi << 12) + lo, lo 为有符号 12 位, 所以 lo 为负时 hi 要进一
+void SplitImm(int64_t c, int64_t &hi, int64_t &lo) {
+  int32_t v = static_cast<int32_t>(c);
+  lo = static_cast<int32_t>(static_cast<uint32_t>(v) << 20) >> 20;
+  hi = ((static_cast<int64_t>(v) - lo) >> 12) & 0xfffff;
+}
+
+// 虚拟寄存器 -> 装入它的 li 常量
+std::map<int, int64_t> ConstVRegs(const MachineFunction &mf) {
+  std::map<int, int64_t> consts;
+  for (const auto &block : mf.blocks)
+    for (const auto &inst : block.insts)
+      if (inst.op == MOpcode::LI && IsVirtReg(inst.rd))
+        consts[inst.rd] = inst.imm;
+  return consts;
+}
+
+// op rd, rs, r 且 r 为常量时改写为立即数形式
+void FoldImmediates(MachineFunction &mf) {
+  auto consts = ConstVRegs(mf);
+  for (auto &block : mf.blocks) {
+    for (auto &inst : block.insts) {
+      const ImmForm *form = FindImmForm(inst.op);
+      if (!form) continue;
+      int src;
+      int64_t c;
+      if (consts.count(inst.rs2)) {
+        src = inst.rs1, c = consts[inst.rs2];
+      } else if (form->commutative && consts.count(inst.rs1)) {
+        src = inst.rs2, c = consts[inst.rs1];
+      } else {
+        continue;
+      }
+      if (inst.op == MOpcode::SUB) c = -c;
+      if (form->shift) c &= 31;
+      if (!RiscVCommon::IsImm12(c)) continue;
+      inst = MachineInstr{form->op, inst.rd, src, kNoReg, c};
+    }
+  }
+}
+
+// 块内相同的 li / lui 只保留第一条, 其余的使用者改用第一条的结果
+void ReuseConstants(MachineFunction &mf) {
+  std::map<int, int> replace;
+  for (auto &block : mf.blocks) {
+    std::map<std::pair<MOpcode, int64_t>, int> held;
+    std::vector<MachineInstr> insts;
+    for (auto inst : block.insts) {
+      for (int r : inst.Uses())
+        if (replace.count(r)) inst.ReplaceUse(r, replace[r]);
+      bool is_const = inst.op == MOpcode::LI || inst.op == MOpcode::LUI;
+      if (is_const && IsVirtReg(inst.rd)) {
+        auto key = std::make_pair(inst.op, inst.imm);
+        auto it = held.find(key);
+        if (it != held.end()) {
+          replace[inst.rd] = it->second;
+          continue;
+        }
+        held[key] = inst.rd;
+      }
+      insts.push_back(inst);
+    }
+    block.insts = std::move(insts);
+  }
+  // 使用者可能在别的块中
+  for (auto &block : mf.blocks)
+    for (auto &inst : block.insts)
+      for (int r : inst.Uses())
+        if (replace.count(r)) inst.ReplaceUse(r, replace[r]);
+}
+
+// 超出 12 位的 li 拆成 lui + addi
+void SplitLargeConstants(MachineFunction &mf) {
+  for (auto &block : mf.blocks) {
+    std::vector<MachineInstr> insts;
+    for (const auto &inst : block.insts) {
+      if (inst.op != MOpcode::LI || RiscVCommon::IsImm12(inst.imm)) {
+        insts.push_back(inst);
+        continue;
+      }
+      int64_t hi, lo;
+      SplitImm(inst.imm, hi, lo);
+      if (lo == 0) {
+        insts.push_back(MachineInstr{MOpcode::LUI, inst.rd, kNoReg, kNoReg, hi});
+        continue;
+      }
+      int upper = mf.NewVReg();
+      insts.push_back(MachineInstr{MOpcode::LUI, upper, kNoReg, kNoReg, hi});
+      insts.push_back(MachineInstr{MOpcode::ADDI, inst.rd, upper, kNoReg, lo});
+    }
+    block.insts = std::move(insts);
+  }
+}
+
+}  // namespace
+
+void EmitLoadImm(int rd, int64_t c, std::vector<MachineInstr> &out) {
+  if (RiscVCommon::IsImm12(c)) {
+    out.push_back(MachineInstr{MOpcode::LI, rd, kNoReg, kNoReg, c});
+    return;
+  }
+  int64_t hi, lo;
+  SplitImm(c, hi, lo);
+  out.push_back(MachineInstr{MOpcode::LUI, rd, kNoReg, kNoReg, hi});
+  if (lo != 0) out.push_back(MachineInstr{MOpcode::ADDI, rd, rd, kNoReg, lo});
+}
+
+void LowerConstants(MachineFunction &mf) {
+  FoldImmediates(mf);
+  RemoveDeadDefs(mf);
+  ReuseConstants(mf);
+  SplitLargeConstants(mf);
+  // 拆分后高 20 位相同的常量共用 lui
+  ReuseConstants(mf);
+}
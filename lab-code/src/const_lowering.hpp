@@ -0,0 +1,12 @@
+#pragma once
+#include <vector>
+#include "mir.hpp"
+
+// 把常量 c 装入 rd: 12 位立即数用 li, 否则拆成 lui + addi
+void EmitLoadImm(int rd, int64_t c, std::vector<MachineInstr> &out);
+
+// 寄存器分配前的常量处理, 此时每个虚拟寄存器只有一次定值:
+// - 常量操作数折叠进 I 型指令的立即数
+// - 同一块内相同的常量只装入一次
+// - 超出 12 位的常量拆成 lui + addi, 高 20 位相同的常量共用 lui
+void LowerConstants(MachineFunction &mf);
@@ -0,0 +1,208 @@
+#include "frame_lowering.hpp"
+#include "regalloc.hpp"
+#include "const_lowering.hpp"
+#include "target.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <set>
+#include <tuple>
+
+namespace {
+
+// sp += delta, delta 超出 12 位立即数时借用溢出临时寄存器
+void AdjustSp(int delta, std::vector<MachineInstr> &out) {
+  if (delta == 0) return;
+  if (RiscVCommon::IsImm12(delta)) {
+    out.push_back(MachineInstr{MOpcode::ADDI, SP, SP, kNoReg, delta});
+  } else {
+    int tmp = RiscVCommon::kSpillScratch[0];
+    EmitLoadImm(tmp, delta, out);
+    out.push_back(MachineInstr{MOpcode::ADD, SP, SP, tmp});
+  }
+}
+
+// 把 inst 中的栈上对象换成 offset(sp), 偏移过大时先把地址算进寄存器
+void RewriteFrameIndex(MachineInstr inst, int offset,
+                       std::vector<MachineInstr> &out) {
+  inst.frame_index = -1;
+  if (RiscVCommon::IsImm12(offset)) {
+    inst.rs1 = SP;
+    inst.imm = offset;
+    out.push_back(inst);
+    return;
+  }
+  // load 可以直接用目的寄存器算地址, store 用另一个临时寄存器
+  const auto &scratch = RiscVCommon::kSpillScratch;
+  int addr = inst.format() == MFormat::Load ? inst.rd
+             : inst.rs2 == scratch[1]       ? scratch[0]
+                                            : scratch[1];
+  EmitLoadImm(addr, offset, out);
+  out.push_back(MachineInstr{MOpcode::ADD, addr, addr, SP});
+  inst.rs1 = addr;
+  inst.imm = 0;
+  out.push_back(inst);
+}
+
+// 块的执行频率估计: 每层循环 (按回边识别) 乘以 8
+std::vector<int64_t> BlockWeights(const MachineFunction &mf) {
+  std::vector<int64_t> weight(mf.blocks.size(), 1);
+  for (int b = 0; b < int(mf.blocks.size()); ++b)
+    for (int s : mf.Successors(b))
+      if (s <= b)
+        for (int k = s; k <= b; ++k) weight[k] *= 8;
+  return weight;
+}
+
+// 栈上对象的活跃区间, 位置编号方式与寄存器分配相同: sw 为定值, lw 为使用
+struct ObjectInterval {
+  int start = INT32_MAX, end = -1;
+  int64_t weight = 0;  // 按块频率加权的访问次数
+};
+
+std::vector<ObjectInterval> BuildObjectIntervals(const MachineFunction &mf) {
+  size_t n = mf.blocks.size();
+  std::vector<std::set<int>> gen(n), kill(n), live_in(n), live_out(n);
+  for (size_t b = 0; b < n; ++b) {
+    for (const auto &inst : mf.blocks[b].insts) {
+      if (inst.frame_index < 0) continue;
+      if (inst.format() == MFormat::Load && !kill[b].count(inst.frame_index))
+        gen[b].insert(inst.frame_index);
+      if (inst.format() == MFormat::Store) kill[b].insert(inst.frame_index);
+    }
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t b = n; b-- > 0;) {
+      std::set<int> out;
+      for (int s : mf.Successors(b))
+        out.insert(live_in[s].begin(), live_in[s].end());
+      std::set<int> in = gen[b];
+      for (int fi : out)
+        if (!kill[b].count(fi)) in.insert(fi);
+      if (in != live_in[b] || out != live_out[b]) {
+        live_in[b] = std::move(in);
+        live_out[b] = std::move(out);
+        changed = true;
+      }
+    }
+  }
+
+  auto weights = BlockWeights(mf);
+  std::vector<ObjectInterval> intervals(mf.frame_objects.size());
+  auto extend = [&](int fi, int pos) {
+    intervals[fi].start = std::min(intervals[fi].start, pos);
+    intervals[fi].end = std::max(intervals[fi].end, pos);
+  };
+  int pos = 2;
+  for (size_t b = 0; b < n; ++b) {
+    for (int fi : live_in[b]) extend(fi, pos - 1);
+    for (const auto &inst : mf.blocks[b].insts) {
+      if (inst.frame_index >= 0) {
+        extend(inst.frame_index, pos);
+        intervals[inst.frame_index].weight += weights[b];
+      }
+      pos += 2;
+    }
+    for (int fi : live_out[b]) extend(fi, pos - 1);
+  }
+  return intervals;
+}
+
+// 区间着色: 活跃区间不重叠的栈上对象共用一个槽; 再按访问频率从高到低
+// 排列槽, 让常用的槽离 sp 更近
+void AssignFrameOffsets(MachineFunction &mf) {
+  auto intervals = BuildObjectIntervals(mf);
+  std::vector<int> order;
+  for (int fi = 0; fi < int(intervals.size()); ++fi)
+    if (intervals[fi].end >= 0) order.push_back(fi);
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return std::tie(intervals[a].start, a) < std::tie(intervals[b].start, b);
+  });
+
+  struct Slot {
+    int size = 0;
+    int end = -1;  // 当前占用者的区间终点
+    int64_t weight = 0;
+    std::vector<int> objects;
+  };
+  std::vector<Slot> slots;
+  for (int fi : order) {
+    const auto &iv = intervals[fi];
+    int size = mf.frame_objects[fi].size;
+    // 优先复用大小最接近的空闲槽
+    Slot *best = nullptr;
+    for (auto &slot : slots)
+      if (slot.end < iv.start && (!best || std::abs(slot.size - size) <
+                                               std::abs(best->size - size)))
+        best = &slot;
+    if (!best) {
+      slots.emplace_back();
+      best = &slots.back();
+    }
+    best->size = std::max(best->size, size);
+    best->end = iv.end;
+    best->weight += iv.weight;
+    best->objects.push_back(fi);
+  }
+  std::stable_sort(slots.begin(), slots.end(), [](const Slot &a, const Slot &b) {
+    return a.weight > b.weight;
+  });
+
+  int offset = 0;
+  for (const auto &slot : slots) {
+    // 8 字节以上的槽 (RV64 上保存的寄存器) 按 8 字节对齐
+    int align = slot.size >= 8 ? 8 : 4;
+    offset = (offset + align - 1) / align * align;
+    for (int fi : slot.objects) mf.frame_objects[fi].offset = offset;
+    offset += (slot.size + 3) / 4 * 4;
+  }
+  // 栈帧按 16 字节对齐
+  mf.frame_size = (offset + 15) / 16 * 16;
+}
+
+}  // namespace
+
+template <class Target>
+void LowerFrame(MachineFunction &mf) {
+  // 被调用者保存寄存器也作为栈上对象, 与其他对象一起参与布局
+  std::vector<std::pair<int, int>> saves;
+  for (int r : mf.callee_saved)
+    saves.emplace_back(r, mf.NewFrameObject(Target::kRegBytes, true));
+  if (!saves.empty()) {
+    for (auto &block : mf.blocks) {
+      std::vector<MachineInstr> insts;
+      if (&block == &mf.blocks[0])
+        for (auto &[r, fi] : saves)
+          insts.push_back(
+              MachineInstr{Target::kSaveOp, kNoReg, SP, r, 0, -1, fi});
+      for (const auto &inst : block.insts) {
+        if (inst.op == MOpcode::RET)
+          for (auto &[r, fi] : saves)
+            insts.push_back(
+                MachineInstr{Target::kRestoreOp, r, SP, kNoReg, 0, -1, fi});
+        insts.push_back(inst);
+      }
+      block.insts = std::move(insts);
+    }
+  }
+  AssignFrameOffsets(mf);
+
+  for (size_t b = 0; b < mf.blocks.size(); ++b) {
+    std::vector<MachineInstr> insts;
+    if (b == 0) AdjustSp(-mf.frame_size, insts);
+    for (const auto &inst : mf.blocks[b].insts) {
+      if (inst.op == MOpcode::RET) AdjustSp(mf.frame_size, insts);
+      if (inst.frame_index >= 0)
+        RewriteFrameIndex(inst, mf.frame_objects[inst.frame_index].offset,
+                          insts);
+      else
+        insts.push_back(inst);
+    }
+    mf.blocks[b].insts = std::move(insts);
+  }
+}
+
+template void LowerFrame<RV32>(MachineFunction &);
+template void LowerFrame<RV64>(MachineFunction &);
@@ -0,0 +1,9 @@
+#pragma once
+#include "mir.hpp"
+
+// 栈帧布局: 给被调用者保存寄存器和栈上对象分配 sp 偏移, 插入序言与尾声,
+// 并把访存指令中的栈上对象改写为 sp 偏移. 活跃区间不重叠的对象共用栈槽,
+// 访问频繁的槽放在低偏移处. 需在寄存器分配之后调用.
+// Target 为 target.hpp 中的目标描述, 决定保存寄存器的宽度.
+template <class Target>
+void LowerFrame(MachineFunction &mf);
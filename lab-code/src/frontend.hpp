@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "AST.hpp"
+#include "arena.hpp"
+#include "source_buffer.hpp"
+
+// 词法单元的文本, 直接指向源程序缓冲区而不复制
+struct TokenText {
+  const char *ptr;
+  size_t len;
+
+  std::string_view view() const { return {ptr, len}; }
+};
+
+// 一次解析的全部状态, 由 pure parser 和 reentrant scanner 共享,
+// 不同的解析可以在不同线程中同时进行
+struct ParseContext {
+  // AST 结点和标识符文本都分配在这里, 随 ParseContext 一起释放
+  Arena arena;
+  const BaseAST *ast = nullptr;
+  // 已归约的函数定义, 解析完成时复制到 CompUnitAST 中
+  std::vector<const BaseAST *> func_defs;
+  std::vector<std::string> errors;
+  // 块注释的嵌套深度
+  int comment_depth = 0;
+  // 非空时输出每条规则的归约过程
+  std::ostream *trace = nullptr;
+  // 非空时每个函数定义一归约完就交给它, 不再收集到 ast 中;
+  // 返回 false 时中止解析. 它返回后该函数的 AST 随 arena 一起重置
+  std::function<bool(const BaseAST &)> on_func_def;
+
+  std::ostream &Trace() { return trace ? *trace : null_stream; }
+
+  // 把归约完成的函数定义交给 on_func_def, 或者追加到 func_defs
+  bool AddFuncDef(const BaseAST *func_def) {
+    if (!on_func_def) {
+      func_defs.push_back(func_def);
+      return true;
+    }
+    bool ok = on_func_def(*func_def);
+    // 归约 FuncDefList 时 parser 栈上只有这个函数的结点在 arena 中
+    arena.Reset();
+    return ok;
+  }
+
+ private:
+  std::ostream null_stream{nullptr};
+};
+
+// 在 src 上原地解析, 成功时结果在 ctx.ast, 失败时错误信息在 ctx.errors.
+// 扫描期间 src 的内容会被临时改写, 无论成功与否, 返回前都会恢复原样.
+// 标识符直接指向 src, src 要比得到的 AST 活得久
+bool ParseSource(SourceBuffer &src, ParseContext &ctx);
@@ -0,0 +1,131 @@
+#include "if_conversion.hpp"
+
+namespace {
+
+// 每个分支臂最多搬移的指令数
+constexpr size_t kMaxArmInsts = 4;
+
+// 分支臂: 只有一个前驱, 若干无副作用的指令后写入一个栈上对象, 再跳向汇合块
+struct Arm {
+  int block = -1;
+  int merge = -1;
+  int value = kNoReg;
+  int frame_index = -1;
+};
+
+bool MatchArm(const MachineFunction &mf, const std::vector<int> &npreds, int b,
+              Arm &arm) {
+  const auto &insts = mf.blocks[b].insts;
+  size_t k = insts.size();
+  if (npreds[b] != 1 || k < 2 || k - 2 > kMaxArmInsts ||
+      insts[k - 1].op != MOpcode::J || insts[k - 2].op != MOpcode::SW)
+    return false;
+  for (size_t i = 0; i + 2 < k; ++i)
+    if (insts[i].op == MOpcode::SW || insts[i].IsTerminator()) return false;
+  arm = Arm{b, insts[k - 1].target, insts[k - 2].rs2, insts[k - 2].frame_index};
+  return true;
+}
+
+// 生成 r = c ? x : y, 无法生成时返回 kNoReg
+int Select(MachineFunction &mf, const TargetFeatures &features, int c, int x,
+           int y, std::vector<MachineInstr> &insts) {
+  if (x == y) return x;
+  if (!features.zicond) return kNoReg;
+  // czero.eqz a, x, c: c 为 0 时得 0, 否则得 x; czero.nez 相反
+  int a = ZERO, b = ZERO;
+  if (x != ZERO) {
+    a = mf.NewVReg();
+    insts.push_back(MachineInstr{MOpcode::CZERO_EQZ, a, x, c});
+  }
+  if (y != ZERO) {
+    b = mf.NewVReg();
+    insts.push_back(MachineInstr{MOpcode::CZERO_NEZ, b, y, c});
+  }
+  if (a == ZERO) return b;
+  if (b == ZERO) return a;
+  int r = mf.NewVReg();
+  insts.push_back(MachineInstr{MOpcode::OR, r, a, b});
+  return r;
+}
+
+// 尝试转换以 b 结尾的分支, 成功返回 true
+bool ConvertBlock(MachineFunction &mf, const TargetFeatures &features,
+                  const std::vector<int> &npreds, int b) {
+  auto &head = mf.blocks[b].insts;
+  size_t k = head.size();
+  if (k < 2 || head[k - 2].op != MOpcode::BNEZ || head[k - 1].op != MOpcode::J)
+    return false;
+  int cond = head[k - 2].rs1;
+  int t = head[k - 2].target, f = head[k - 1].target;
+  if (t == b || f == b || t == f) return false;
+
+  // 分支前最后一次写入 fi 的值, 作为没有写入的一边的结果
+  auto value_before = [&](int fi) {
+    for (size_t i = k - 2; i-- > 0;)
+      if (head[i].op == MOpcode::SW && head[i].frame_index == fi)
+        return head[i].rs2;
+    return int(kNoReg);
+  };
+  Arm ta, fa;
+  bool has_t = MatchArm(mf, npreds, t, ta);
+  bool has_f = MatchArm(mf, npreds, f, fa);
+  int merge, fi, x, y;
+  std::vector<int> arms;
+  if (has_t && has_f && ta.merge == fa.merge &&
+      ta.frame_index == fa.frame_index) {
+    // 菱形: 两边都写
+    merge = ta.merge, fi = ta.frame_index, x = ta.value, y = fa.value;
+    arms = {t, f};
+  } else if (has_t && ta.merge == f) {
+    // 三角形: 只有条件成立的一边写
+    merge = f, fi = ta.frame_index, x = ta.value, y = value_before(fi);
+    arms = {t};
+  } else if (has_f && fa.merge == t) {
+    merge = t, fi = fa.frame_index, x = value_before(fi), y = fa.value;
+    arms = {f};
+  } else {
+    return false;
+  }
+  if (x == kNoReg || y == kNoReg || merge == b) return false;
+
+  std::vector<MachineInstr> insts(head.begin(), head.end() - 2);
+  for (int arm : arms) {
+    const auto &body = mf.blocks[arm].insts;
+    insts.insert(insts.end(), body.begin(), body.end() - 2);
+  }
+  int r = Select(mf, features, cond, x, y, insts);
+  if (r == kNoReg) return false;
+  insts.push_back(MachineInstr{MOpcode::SW, kNoReg, SP, r, 0, -1, fi});
+  insts.push_back(MachineInstr{MOpcode::J, kNoReg, kNoReg, kNoReg, 0, merge});
+  head = std::move(insts);
+  // 原来的分支臂变为不可达, 由块布局删除
+  for (int arm : arms)
+    mf.blocks[arm].insts = {
+        MachineInstr{MOpcode::J, kNoReg, kNoReg, kNoReg, 0, merge}};
+  return true;
+}
+
+}  // namespace
+
+void IfConvert(MachineFunction &mf, const TargetFeatures &features) {
+  if (!features.zicond) return;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    // 不可达块不计入前驱
+    std::vector<int> npreds(mf.blocks.size(), 0);
+    std::vector<bool> reachable(mf.blocks.size(), false);
+    std::vector<int> work{0};
+    reachable[0] = true;
+    while (!work.empty()) {
+      int b = work.back();
+      work.pop_back();
+      for (int s : mf.Successors(b)) {
+        npreds[s]++;
+        if (!reachable[s]) reachable[s] = true, work.push_back(s);
+      }
+    }
+    for (int b = 0; b < int(mf.blocks.size()) && !changed; ++b)
+      if (reachable[b]) changed = ConvertBlock(mf, features, npreds, b);
+  }
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "mir.hpp"
+#include "target.hpp"
+
+// 把只在两个值之间选择的小分支 (两边各向同一个栈上对象写一个值,
+// 或一边写、另一边沿用分支前写入的值) 改写为 Zicond 的 czero.eqz / czero.nez.
+// 需在指令选择之后、块布局之前调用, 此时每个块都以显式的跳转结尾.
+void IfConvert(MachineFunction &mf, const TargetFeatures &features);
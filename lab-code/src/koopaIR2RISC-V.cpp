@@ -2,164 +2,373 @@
 #include "koopa.h"
 #include <map>
 #include <string>
-#include <cassert>
-
-// 寄存器列表
-static const char* regs[] = {"t0", "t1", "t2", "t3", "t4", "t5", "t6"};
-
-void Visit(const koopa_raw_program_t &program, std::ofstream &riscv_out);
-void Visit(const koopa_raw_slice_t &slice, std::ofstream &riscv_out,
-           std::map<const koopa_raw_value_t, std::string> &reg_map, int &reg_cnt);
-void Visit(const koopa_raw_function_t &func, std::ofstream &riscv_out);
-void Visit(const koopa_raw_basic_block_t &bb, std::ofstream &riscv_out,
-          std::map<const koopa_raw_value_t, std::string> &reg_map, int &reg_cnt);
-void Visit(const koopa_raw_value_t value, std::ofstream &riscv_out,
-            std::map<const koopa_raw_value_t, std::string> &reg_map, int &reg_cnt);
-
-void Visit(const koopa_raw_program_t &program, std::ofstream &riscv_out) {
-  std::map<const koopa_raw_value_t, std::string> reg_map;
-  int reg_cnt = 0;
-  Visit(program.funcs, riscv_out, reg_map, reg_cnt);
+#include <vector>
+#include <stdexcept>
+#include "range_analysis.hpp"
+#include "koopaIR2RISC-V.hpp"
+#include "mir.hpp"
+#include "schedule.hpp"
+#include "regalloc.hpp"
+#include "peephole.hpp"
+#include "frame_lowering.hpp"
+#include "const_lowering.hpp"
+#include "block_placement.hpp"
+#include "if_conversion.hpp"
+
+// 函数内的指令选择状态
+struct FuncContext {
+  MachineFunction *mf = nullptr;
+  // 每个值在整个函数内的使用次数, 没有使用的值不生成代码
+  std::map<const koopa_raw_value_t, int> uses;
+  // 值所在的虚拟寄存器
+  std::map<const koopa_raw_value_t, int> vregs;
+  // alloc 对应的栈上对象
+  std::map<const koopa_raw_value_t, int> slots;
+  std::map<koopa_raw_basic_block_t, int> blocks;
+  const RangeAnalysis *ranges = nullptr;
+  koopa_raw_basic_block_t bb = nullptr;
+};
+
+void Visit(const koopa_raw_program_t &program, std::ostream &riscv_out,
+           const BackendOptions &opts);
+void Visit(const koopa_raw_slice_t &slice, FuncContext &ctx);
+void Visit(const koopa_raw_function_t &func, std::ostream &riscv_out,
+           const BackendOptions &opts);
+void Visit(const koopa_raw_basic_block_t &bb, FuncContext &ctx);
+void Visit(const koopa_raw_value_t value, FuncContext &ctx);
+
+void Visit(const koopa_raw_program_t &program, std::ostream &riscv_out,
+           const BackendOptions &opts) {
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+    Visit(func, riscv_out, opts);
+  }
 }
 
-void Visit(const koopa_raw_slice_t &slice, std::ofstream &riscv_out,
-           std::map<const koopa_raw_value_t, std::string> &reg_map, int &reg_cnt) {
+void Visit(const koopa_raw_slice_t &slice, FuncContext &ctx) {
   for (size_t i = 0; i < slice.len; ++i) {
     auto ptr = slice.buffer[i];
     switch (slice.kind) {
-      case KOOPA_RSIK_FUNCTION:
-        Visit(reinterpret_cast<koopa_raw_function_t>(ptr), riscv_out);
-        break;
       case KOOPA_RSIK_BASIC_BLOCK:
-        Visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr), riscv_out, reg_map, reg_cnt);
+        Visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr), ctx);
         break;
       case KOOPA_RSIK_VALUE:
-        Visit(reinterpret_cast<koopa_raw_value_t>(ptr), riscv_out, reg_map, reg_cnt);
+        Visit(reinterpret_cast<koopa_raw_value_t>(ptr), ctx);
         break;
       default:
-        assert(false);
+        throw std::runtime_error("unsupported Koopa IR slice kind");
+    }
+  }
+}
+
+// 指令用到的非常量操作数
+static std::vector<koopa_raw_value_t> Operands(koopa_raw_value_t inst) {
+  std::vector<koopa_raw_value_t> ops;
+  auto add = [&](koopa_raw_value_t v) {
+    if (v && v->kind.tag != KOOPA_RVT_INTEGER) ops.push_back(v);
+  };
+  const auto &kind = inst->kind;
+  switch (kind.tag) {
+    case KOOPA_RVT_BINARY:
+      add(kind.data.binary.lhs);
+      add(kind.data.binary.rhs);
+      break;
+    case KOOPA_RVT_LOAD:
+      add(kind.data.load.src);
+      break;
+    case KOOPA_RVT_STORE:
+      add(kind.data.store.value);
+      add(kind.data.store.dest);
+      break;
+    case KOOPA_RVT_BRANCH:
+      add(kind.data.branch.cond);
+      break;
+    case KOOPA_RVT_RETURN:
+      add(kind.data.ret.value);
+      break;
+    default:
+      break;
+  }
+  return ops;
+}
+
+// 统计每个值的使用次数, 给 alloc 分配栈上对象, 给基本块建立机器块
+static void PrepareFunction(const koopa_raw_function_t &func, FuncContext &ctx) {
+  auto &mf = *ctx.mf;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    std::string name = bb->name ? bb->name + 1 : "bb" + std::to_string(i);
+    ctx.blocks[bb] = int(mf.blocks.size());
+    mf.blocks.push_back(MachineBasicBlock{".L" + mf.name + "_" + name, {}});
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      if (inst->kind.tag == KOOPA_RVT_ALLOC)
+        ctx.slots[inst] = mf.NewFrameObject(4, false);
+      for (auto op : Operands(inst)) ctx.uses[op]++;
     }
   }
 }
 
-void Visit(const koopa_raw_function_t &func, std::ofstream &riscv_out) {
-  std::map<const koopa_raw_value_t, std::string> reg_map;
-  int reg_cnt = 0;
-  riscv_out << "  .text\n";
-  std::string func_name = func->name;
-  if (!func_name.empty() && func_name[0] == '@') {
-    func_name = func_name.substr(1);
+// 帧布局和汇编输出按目标描述实例化, 每个函数只按 XLEN 分派一次
+template <class Target>
+static void EmitFunction(MachineFunction &mf, std::ostream &out) {
+  LowerFrame<Target>(mf);
+  PrintFunction<Target>(mf, out);
+}
+
+void Visit(const koopa_raw_function_t &func, std::ostream &riscv_out,
+           const BackendOptions &opts) {
+  RangeAnalysis ranges(func);
+  MachineFunction mf;
+  mf.name = func->name;
+  if (!mf.name.empty() && mf.name[0] == '@') mf.name = mf.name.substr(1);
+  FuncContext ctx;
+  ctx.mf = &mf;
+  ctx.ranges = &ranges;
+  PrepareFunction(func, ctx);
+  Visit(func->bbs, ctx);
+
+  IfConvert(mf, opts.features);
+  LowerConstants(mf);
+  PlaceBlocks(mf);
+  ScheduleFunction(mf, *opts.core, AllocatableRegCount());
+  AllocateRegisters(mf);
+  Peephole(mf);
+  if (opts.features.xlen == 64)
+    EmitFunction<RV64>(mf, riscv_out);
+  else
+    EmitFunction<RV32>(mf, riscv_out);
+}
+
+void Visit(const koopa_raw_basic_block_t &bb, FuncContext &ctx) {
+  ctx.bb = bb;
+  Visit(bb->insts, ctx);
+}
+
+// 2 的正整数次幂返回指数, 否则返回 -1
+static int Log2(int32_t v) {
+  if (v <= 1 || (v & (v - 1)) != 0) return -1;
+  int k = 0;
+  while ((1 << k) != v) ++k;
+  return k;
+}
+
+static void Emit(const MachineInstr &inst, FuncContext &ctx) {
+  ctx.mf->blocks[ctx.blocks[ctx.bb]].insts.push_back(inst);
+}
+
+// 值所在的虚拟寄存器, 第一次用到时分配
+static int VRegOf(koopa_raw_value_t v, FuncContext &ctx) {
+  auto it = ctx.vregs.find(v);
+  if (it != ctx.vregs.end()) return it->second;
+  return ctx.vregs[v] = ctx.mf->NewVReg();
+}
+
+// 把操作数放进寄存器: 0 用 x0, 其余常量用 li 装入新的虚拟寄存器
+static int UseOperand(koopa_raw_value_t v, FuncContext &ctx) {
+  int32_t c;
+  if (ctx.ranges->GetConst(v, ctx.bb, c)) {
+    if (c == 0) return ZERO;
+    int r = ctx.mf->NewVReg();
+    Emit(MachineInstr{MOpcode::LI, r, kNoReg, kNoReg, c}, ctx);
+    return r;
   }
-  riscv_out << "  .globl " << func_name << "\n";
-  riscv_out << func_name << ":\n";
-  Visit(func->bbs, riscv_out, reg_map, reg_cnt);
+  return VRegOf(v, ctx);
 }
 
-void Visit(const koopa_raw_basic_block_t &bb, std::ofstream &riscv_out,
-           std::map<const koopa_raw_value_t, std::string> &reg_map, int &reg_cnt) {
-  Visit(bb->insts, riscv_out, reg_map, reg_cnt);
+static void VisitBinary(const koopa_raw_value_t value, FuncContext &ctx) {
+  auto &bin = value->kind.data.binary;
+  // 结果为常量的运算由使用者直接物化, 没有使用者的运算直接删去
+  int32_t folded;
+  if (ctx.ranges->GetConst(value, ctx.bb, folded) || !ctx.uses.count(value))
+    return;
+
+  Range lr = ctx.ranges->Get(bin.lhs, ctx.bb);
+  int32_t c = 0;
+  bool rhs_const = ctx.ranges->GetConst(bin.rhs, ctx.bb, c);
+  int lhs = UseOperand(bin.lhs, ctx);
+  int rd = VRegOf(value, ctx);
+  auto emit_i = [&](MOpcode op, int dst, int src, int64_t imm) {
+    Emit(MachineInstr{op, dst, src, kNoReg, imm}, ctx);
+  };
+
+  // 右操作数为常量时优先使用立即数形式
+  if (rhs_const) {
+    int k = Log2(c);
+    MOpcode op = MOpcode::ADDI;
+    bool has_imm_form = true;
+    int64_t imm = c;
+    switch (bin.op) {
+      case KOOPA_RBO_ADD: op = MOpcode::ADDI; break;
+      case KOOPA_RBO_SUB: op = MOpcode::ADDI; imm = -int64_t(c); break;
+      case KOOPA_RBO_AND: op = MOpcode::ANDI; break;
+      case KOOPA_RBO_OR: op = MOpcode::ORI; break;
+      case KOOPA_RBO_XOR: op = MOpcode::XORI; break;
+      case KOOPA_RBO_LT: op = MOpcode::SLTI; break;
+      case KOOPA_RBO_SHL: op = MOpcode::SLLI; imm = c & 31; break;
+      case KOOPA_RBO_SHR: op = MOpcode::SRLI; imm = c & 31; break;
+      case KOOPA_RBO_SAR: op = MOpcode::SRAI; imm = c & 31; break;
+      case KOOPA_RBO_DIV:
+        // 被除数非负时, 除以 2^k 即为算术右移
+        has_imm_form = k >= 0 && lr.NonNegative();
+        op = MOpcode::SRAI, imm = k;
+        break;
+      case KOOPA_RBO_MOD:
+        // 被除数非负时, 模 2^k 即为取低 k 位
+        if (k >= 0 && lr.NonNegative()) {
+          if (RiscVCommon::IsImm12(c - 1)) {
+            emit_i(MOpcode::ANDI, rd, lhs, c - 1);
+          } else {
+            int t = ctx.mf->NewVReg();
+            emit_i(MOpcode::SLLI, t, lhs, 32 - k);
+            emit_i(MOpcode::SRLI, rd, t, 32 - k);
+          }
+          return;
+        }
+        has_imm_form = false;
+        break;
+      case KOOPA_RBO_EQ:
+      case KOOPA_RBO_NOT_EQ: {
+        has_imm_form = false;
+        MOpcode set = bin.op == KOOPA_RBO_EQ ? MOpcode::SEQZ : MOpcode::SNEZ;
+        if (c != 0 && !RiscVCommon::IsImm12(-int64_t(c))) break;
+        if (c == 0 && lr.lo == 0 && lr.hi == 1) {
+          // 布尔值与 0 比较: ne 即原值, eq 即取反
+          if (bin.op == KOOPA_RBO_NOT_EQ)
+            Emit(MachineInstr{MOpcode::MV, rd, lhs}, ctx);
+          else
+            emit_i(MOpcode::XORI, rd, lhs, 1);
+        } else if (c == 0) {
+          Emit(MachineInstr{set, rd, lhs}, ctx);
+        } else {
+          int t = ctx.mf->NewVReg();
+          emit_i(MOpcode::ADDI, t, lhs, -int64_t(c));
+          Emit(MachineInstr{set, rd, t}, ctx);
+        }
+        return;
+      }
+      default:
+        has_imm_form = false;
+        break;
+    }
+    if (has_imm_form && RiscVCommon::IsImm12(imm)) {
+      emit_i(op, rd, lhs, imm);
+      return;
+    }
+  }
+
+  int rhs = UseOperand(bin.rhs, ctx);
+  auto emit_r = [&](MOpcode op, int dst, int a, int b) {
+    Emit(MachineInstr{op, dst, a, b}, ctx);
+  };
+  int t = kNoReg;
+  switch (bin.op) {
+    case KOOPA_RBO_NOT_EQ:
+    case KOOPA_RBO_EQ:
+      t = ctx.mf->NewVReg();
+      emit_r(MOpcode::XOR, t, lhs, rhs);
+      Emit(MachineInstr{bin.op == KOOPA_RBO_EQ ? MOpcode::SEQZ : MOpcode::SNEZ,
+                        rd, t},
+           ctx);
+      break;
+    case KOOPA_RBO_GT:
+      emit_r(MOpcode::SLT, rd, rhs, lhs);
+      break;
+    case KOOPA_RBO_LT:
+      emit_r(MOpcode::SLT, rd, lhs, rhs);
+      break;
+    case KOOPA_RBO_GE:
+      t = ctx.mf->NewVReg();
+      emit_r(MOpcode::SLT, t, lhs, rhs);
+      emit_i(MOpcode::XORI, rd, t, 1);
+      break;
+    case KOOPA_RBO_LE:
+      t = ctx.mf->NewVReg();
+      emit_r(MOpcode::SLT, t, rhs, lhs);
+      emit_i(MOpcode::XORI, rd, t, 1);
+      break;
+    case KOOPA_RBO_ADD: emit_r(MOpcode::ADD, rd, lhs, rhs); break;
+    case KOOPA_RBO_SUB: emit_r(MOpcode::SUB, rd, lhs, rhs); break;
+    case KOOPA_RBO_MUL: emit_r(MOpcode::MUL, rd, lhs, rhs); break;
+    case KOOPA_RBO_DIV: emit_r(MOpcode::DIV, rd, lhs, rhs); break;
+    case KOOPA_RBO_MOD: emit_r(MOpcode::REM, rd, lhs, rhs); break;
+    case KOOPA_RBO_AND: emit_r(MOpcode::AND, rd, lhs, rhs); break;
+    case KOOPA_RBO_OR: emit_r(MOpcode::OR, rd, lhs, rhs); break;
+    case KOOPA_RBO_XOR: emit_r(MOpcode::XOR, rd, lhs, rhs); break;
+    case KOOPA_RBO_SHL: emit_r(MOpcode::SLL, rd, lhs, rhs); break;
+    case KOOPA_RBO_SHR: emit_r(MOpcode::SRL, rd, lhs, rhs); break;
+    case KOOPA_RBO_SAR: emit_r(MOpcode::SRA, rd, lhs, rhs); break;
+    default:
+      throw std::runtime_error("unsupported Koopa IR binary operator");
+  }
 }
 
-void Visit(const koopa_raw_value_t value, std::ofstream &riscv_out,
-           std::map<const koopa_raw_value_t, std::string> &reg_map, int &reg_cnt) {
+void Visit(const koopa_raw_value_t value, FuncContext &ctx) {
   const auto &kind = value->kind;
   switch (kind.tag) {
-    case KOOPA_RVT_INTEGER: {
+    case KOOPA_RVT_INTEGER:
+    case KOOPA_RVT_ALLOC: {
       break;
     }
     case KOOPA_RVT_BINARY: {
-      std::string rd = regs[reg_cnt++];
-      reg_map[value] = rd;
-      auto &bin = kind.data.binary;
-      std::string lhs, rhs;
-      if (bin.lhs->kind.tag == KOOPA_RVT_INTEGER)
-        lhs = std::to_string(bin.lhs->kind.data.integer.value);
-      else
-        lhs = reg_map[bin.lhs];
-      if (bin.rhs->kind.tag == KOOPA_RVT_INTEGER)
-        rhs = std::to_string(bin.rhs->kind.data.integer.value);
-      else
-        rhs = reg_map[bin.rhs];
-      switch (bin.op) {
-        case KOOPA_RBO_EQ:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  xor   " << rd << ", " << rd << ", " << rhs << "\n";
-          riscv_out << "  seqz  " << rd << ", " << rd << "\n";
-          break;
-        case KOOPA_RBO_GT:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  sgt   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_LT:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  slt   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_GE:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  sge   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_LE:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  sle   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_ADD:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  add   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_SUB:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  sub   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_MUL:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  mul   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_DIV:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  div   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_MOD:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  rem   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_AND:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  and   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_OR:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  or    " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_XOR:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  xor   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_SHL:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  sll   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_SHR:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  srl   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        case KOOPA_RBO_SAR:
-          riscv_out << "  li    " << rd << ", " << lhs << "\n";
-          riscv_out << "  sra   " << rd << ", " << rd << ", " << rhs << "\n";
-          break;
-        default:
-          break;
+      VisitBinary(value, ctx);
+      break;
+    }
+    case KOOPA_RVT_LOAD: {
+      int32_t c;
+      if (ctx.ranges->GetConst(value, ctx.bb, c) || !ctx.uses.count(value))
+        break;
+      if (!ctx.slots.count(kind.data.load.src))
+        throw std::runtime_error("load from a value that is not an alloc");
+      Emit(MachineInstr{MOpcode::LW, VRegOf(value, ctx), SP, kNoReg, 0, -1,
+                        ctx.slots[kind.data.load.src]},
+           ctx);
+      break;
+    }
+    case KOOPA_RVT_STORE: {
+      auto &store = kind.data.store;
+      if (!ctx.slots.count(store.dest))
+        throw std::runtime_error("store to a value that is not an alloc");
+      int src = UseOperand(store.value, ctx);
+      Emit(MachineInstr{MOpcode::SW, kNoReg, SP, src, 0, -1,
+                        ctx.slots[store.dest]},
+           ctx);
+      break;
+    }
+    case KOOPA_RVT_BRANCH: {
+      auto &br = kind.data.branch;
+      int32_t c;
+      int true_bb = ctx.blocks[br.true_bb], false_bb = ctx.blocks[br.false_bb];
+      if (ctx.ranges->GetConst(br.cond, ctx.bb, c)) {
+        // 条件恒定, 只跳向会走的那一边
+        Emit(MachineInstr{MOpcode::J, kNoReg, kNoReg, kNoReg, 0,
+                          c ? true_bb : false_bb},
+             ctx);
+      } else {
+        Emit(MachineInstr{MOpcode::BNEZ, kNoReg, VRegOf(br.cond, ctx), kNoReg,
+                          0, true_bb},
+             ctx);
+        Emit(MachineInstr{MOpcode::J, kNoReg, kNoReg, kNoReg, 0, false_bb},
+             ctx);
       }
       break;
     }
+    case KOOPA_RVT_JUMP: {
+      Emit(MachineInstr{MOpcode::J, kNoReg, kNoReg, kNoReg, 0,
+                        ctx.blocks[kind.data.jump.target]},
+           ctx);
+      break;
+    }
     case KOOPA_RVT_RETURN: {
       auto &ret = kind.data.ret;
-      std::string src;
-      if (ret.value->kind.tag == KOOPA_RVT_INTEGER)
-        src = std::to_string(ret.value->kind.data.integer.value);
-      else
-        src = reg_map[ret.value];
-      riscv_out << "  li    a0, " << src << "\n";
-      riscv_out << "  ret\n";
+      if (ret.value) {
+        int32_t c;
+        if (ctx.ranges->GetConst(ret.value, ctx.bb, c))
+          Emit(MachineInstr{MOpcode::LI, A0, kNoReg, kNoReg, c}, ctx);
+        else
+          Emit(MachineInstr{MOpcode::MV, A0, VRegOf(ret.value, ctx)}, ctx);
+      }
+      Emit(MachineInstr{MOpcode::RET}, ctx);
       break;
     }
     default:
@@ -167,19 +376,29 @@ void Visit(const koopa_raw_value_t value, std::ofstream &riscv_out,
   }
 }
 
-void deal_koopa(const char* str,const char* fn) 
+void deal_koopa(const char* str, std::ostream &out, const BackendOptions &opts)
 {
   koopa_program_t program;
   koopa_error_code_t ret = koopa_parse_from_string(str, &program);
-  assert(ret == KOOPA_EC_SUCCESS);
+  if (ret != KOOPA_EC_SUCCESS)
+    throw std::runtime_error("cannot parse Koopa IR (error " +
+                             std::to_string(int(ret)) + ")");
 
   koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
   koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
   koopa_delete_program(program);
 
-  std::ofstream riscv_output(fn, std::ios::out | std::ios::trunc);
-  Visit(raw, riscv_output);
-  riscv_output.close();
-
+  try {
+    Visit(raw, out, opts);
+  } catch (...) {
+    koopa_delete_raw_program_builder(builder);
+    throw;
+  }
   koopa_delete_raw_program_builder(builder);
+}
+
+void deal_koopa(const char* str, const char* fn, const BackendOptions &opts)
+{
+  std::ofstream riscv_output(fn, std::ios::out | std::ios::trunc);
+  deal_koopa(str, riscv_output, opts);
 }
\ No newline at end of file
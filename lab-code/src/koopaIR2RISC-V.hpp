@@ -0,0 +1,24 @@
+#pragma once
+#include <ostream>
+#include "schedule.hpp"
+#include "target.hpp"
+
+// 后端选项, 由命令行 -m 系列参数填写
+struct BackendOptions {
+  // 指令调度使用的延迟模型, 对应 -mtune=<core>
+  const CoreModel *core = &DefaultCoreModel();
+  // 可用的指令集扩展, 对应 -march=<isa>
+  TargetFeatures features;
+  // compile() 并行生成各函数代码的线程数, 对应 -backend-jobs=<n>;
+  // 输出与串行相同. deal_koopa 本身总是串行
+  int jobs = 1;
+};
+
+// 把 Koopa IR 文本翻译为 RISC-V 汇编并写入 out.
+// 无法解析或不支持的 Koopa IR 抛出 std::runtime_error
+void deal_koopa(const char* str, std::ostream &out,
+                const BackendOptions &opts = BackendOptions());
+
+// 同上, 写入文件 fn
+void deal_koopa(const char* str, const char* fn,
+                const BackendOptions &opts = BackendOptions());
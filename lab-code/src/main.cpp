@@ -1,46 +1,183 @@
-#include <cassert>
-#include <cstdio>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <memory>
-#include "AST.hpp"
+#include "batch.hpp"
+#include "compile_cache.hpp"
+#include "server.hpp"
+#include "sysyc.hpp"
 #include <string>
+#include <thread>
 #include <vector>
-#include <map>
 
 using namespace std;
 
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST>& ast);
-extern void deal_koopa(const char* str,const char* fn);
-
+// 用法: compiler -koopa|-riscv <输入>... -o <输出> [-j N] [-mtune=..] [-march=..]
+// [-backend-jobs=N] [-stream]
+// 只有一个输入且没有 -j 时 <输出> 是输出文件; 否则为批量模式, <输出> 是
+// 输出目录. 以 @ 开头的输入是清单文件, 每行一个源文件.
+// -stream 时每个函数解析完就输出, 不必等整个程序解析完.
+//
+// compiler -koopa <输出> -riscv <输出> <输入>... 只解析一次, 同时生成
+// Koopa IR 和 RISC-V; 批量模式下两个 <输出> 都是目录.
+//
+// -cache=<目录> 启用编译缓存, -cache-size=<MiB> 为其大小上限 (默认 256).
+// 再加 -incremental 时按函数缓存, 程序改动后只重新编译改动过的函数.
+// 启用缓存时不输出归约过程和 AST, 无论是否命中.
+//
+// compiler -server <socket> [-j N] 启动常驻编译服务. 设置了环境变量
+// SYSYC_SERVER=<socket> 时, 单文件编译先交给服务, 连不上再在本进程内编译
 int main(int argc, const char *argv[]) {
-    assert(argc == 5);
-    auto mode = argv[1];
-    auto input = argv[2];
-    auto output = argv[4];
-
-    yyin = fopen(input, "r");
-    assert(yyin);
-
-    unique_ptr<BaseAST> ast;
-    auto ret = yyparse(ast);
-    assert(!ret);
-
-    if(mode[1] == 'k') 
-    {
-      ast->Dump();
-      std::vector<std::string> code;
-      std::string koopa_ir = ast->EmitKoopa(code);
-      std::ofstream ofs(output, std::ios::out | std::ios::trunc);
-      ofs << koopa_ir;
-      ofs.close();
-    }
-    else if(mode[1] == 'r') 
-    {
-      std::vector<std::string> code;
-      std::string koopa_ir = ast->EmitKoopa(code);
-      deal_koopa(koopa_ir.c_str(), output);
-    }
-    return 0;
+    // -cache=<目录> [-cache-size=<MiB>] [-incremental] 对所有模式都有效,
+    // 先把它们挑出来
+    string cache_dir;
+    uint64_t cache_mib = 256;
+    bool incremental = false;
+    vector<string> args;
+    for (int i = 1; i < argc; ++i) {
+      string arg = argv[i];
+      if (arg.rfind("-cache=", 0) == 0)
+        cache_dir = arg.substr(7);
+      else if (arg.rfind("-cache-size=", 0) == 0)
+        cache_mib = strtoull(arg.c_str() + 12, nullptr, 10);
+      else if (arg == "-incremental")
+        incremental = true;
+      else
+        args.push_back(arg);
+    }
+    if (incremental && cache_dir.empty()) {
+      cerr << "-incremental requires -cache=<dir>" << endl;
+      return 1;
+    }
+    unique_ptr<CompileCache> cache;
+    if (!cache_dir.empty())
+      cache = make_unique<CompileCache>(cache_dir, cache_mib << 20);
+
+    if (args.size() >= 2 && args[0] == "-server") {
+      ServerOptions server;
+      server.socket_path = args[1];
+      server.jobs = args.size() >= 4 && args[2] == "-j"
+                        ? atoi(args[3].c_str())
+                        : int(thread::hardware_concurrency());
+      server.cache = cache.get();
+      server.incremental = incremental;
+      return RunServer(server, cerr);
+    }
+
+    // -koopa 和 -riscv 同时出现时各自带一个输出路径
+    bool dual = count(args.begin(), args.end(), "-koopa") &&
+                count(args.begin(), args.end(), "-riscv");
+    if (args.size() < 4 ||
+        (!dual && args[0] != "-koopa" && args[0] != "-riscv")) {
+      cerr << "usage: " << argv[0]
+           << " -koopa|-riscv <input>... -o <output> [options]" << endl;
+      return 1;
+    }
+    auto mode = dual ? string("-riscv") : args[0];
+
+    CompileOptions opts;
+    opts.output = mode[1] == 'k' ? OutputKind::Koopa : OutputKind::RiscV;
+    opts.cache = cache.get();
+    opts.incremental = incremental;
+    vector<string> inputs;
+    // 转发给编译服务的参数
+    vector<string> remote_args{mode};
+    string output, koopa_output;
+    int jobs = 0;
+    for (size_t i = dual ? 0 : 1; i < args.size(); ++i) {
+      const string &arg = args[i];
+      if (dual && arg == "-koopa" && i + 1 < args.size()) {
+        koopa_output = args[++i];
+      } else if (dual && arg == "-riscv" && i + 1 < args.size()) {
+        output = args[++i];
+      } else if (dual && arg == "-o") {
+        // 输出路径已经跟在 -koopa / -riscv 后面, 不能再被 -o 覆盖
+        cerr << "usage: " << argv[0]
+             << " -koopa <output> -riscv <output> <input>... [options]"
+             << " (-o is not accepted here)" << endl;
+        return 1;
+      } else if (arg == "-o" && i + 1 < args.size()) {
+        output = args[++i];
+      } else if (arg == "-j" && i + 1 < args.size()) {
+        jobs = atoi(args[++i].c_str());
+        if (jobs <= 0) {
+          cerr << "invalid -j '" << args[i] << "'" << endl;
+          return 1;
+        }
+      } else if (arg[0] == '@') {
+        string error;
+        if (!ReadManifest(arg.substr(1), inputs, error)) {
+          cerr << error << endl;
+          return 1;
+        }
+      } else if (arg[0] != '-') {
+        inputs.push_back(arg);
+      } else if (arg == "-stream") {
+        opts.streaming = true;
+      } else {
+        string error;
+        if (!ParseBackendOption(arg, opts.backend, error)) {
+          cerr << error << endl;
+          return 1;
+        }
+        remote_args.push_back(arg);
+      }
+    }
+    if (output.empty() || (dual && koopa_output.empty())) {
+      cerr << (dual ? "missing output after -koopa or -riscv" : "missing -o")
+           << endl;
+      return 1;
+    }
+
+    if (jobs > 0 || inputs.size() != 1) {
+      BatchOptions batch;
+      batch.compile = opts;
+      batch.inputs = move(inputs);
+      batch.output_dir = output;
+      batch.koopa_dir = koopa_output;
+      batch.jobs = jobs > 0 ? jobs : int(thread::hardware_concurrency());
+      return RunBatch(batch, cerr) == 0 ? 0 : 1;
+    }
+
+    // 源文件映射到内存, scanner 直接在映射上扫描
+    SourceBuffer src;
+    string error;
+    if (!src.Map(inputs[0], error)) {
+      cerr << inputs[0] << ": " << error << endl;
+      return 1;
+    }
+
+    // 编译服务一次只返回一种输出, 同时生成两种时在本进程内编译
+    if (const char *server = getenv("SYSYC_SERVER"); server && !dual) {
+      StringSink result;
+      bool ok;
+      if (CompileRemote(server, remote_args, src.data(), src.size(), result,
+                        ok)) {
+        for (const auto &e : result.errors) cerr << "error: " << e << endl;
+        if (!ok) return 1;
+        ofstream ofs(output, ios::out | ios::trunc);
+        ofs << result.output;
+        return 0;
+      }
+    }
+
+    // 命令行保留原来的调试输出: 归约过程写到 stderr, -koopa 时 AST 写到 stdout.
+    // 启用缓存时不输出, 否则每次都要解析, 缓存就没有意义了
+    if (!cache) {
+      opts.trace = &cerr;
+      if (opts.output == OutputKind::Koopa || dual) opts.ast_dump = &cout;
+    }
+
+    ofstream ofs(output, ios::out | ios::trunc);
+    StreamSink sink(ofs, cerr);
+    unique_ptr<ofstream> koopa_ofs;
+    unique_ptr<StreamSink> koopa_sink;
+    if (dual) {
+      koopa_ofs = make_unique<ofstream>(koopa_output, ios::out | ios::trunc);
+      koopa_sink = make_unique<StreamSink>(*koopa_ofs, cerr);
+      opts.koopa_sink = koopa_sink.get();
+    }
+    return compile(src, opts, sink) ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "mir.hpp"
+#include "target.hpp"
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <utility>
+
+namespace {
+
+// 与 MOpcode 的顺序一一对应
+const OpcodeInfo kOpcodeInfo[] = {
+    {"li", MFormat::Li},      {"lui", MFormat::Li},
+    {"mv", MFormat::Unary},
+    {"seqz", MFormat::Unary}, {"snez", MFormat::Unary},
+    {"add", MFormat::R},      {"sub", MFormat::R},
+    {"mul", MFormat::R},      {"div", MFormat::R},
+    {"rem", MFormat::R},      {"and", MFormat::R},
+    {"or", MFormat::R},       {"xor", MFormat::R},
+    {"slt", MFormat::R},      {"sll", MFormat::R},
+    {"srl", MFormat::R},      {"sra", MFormat::R},
+    {"czero.eqz", MFormat::R}, {"czero.nez", MFormat::R},
+    {"addi", MFormat::I},     {"andi", MFormat::I},
+    {"ori", MFormat::I},      {"xori", MFormat::I},
+    {"slti", MFormat::I},     {"slli", MFormat::I},
+    {"srli", MFormat::I},     {"srai", MFormat::I},
+    {"lw", MFormat::Load},    {"sw", MFormat::Store},
+    {"ld", MFormat::Load},    {"sd", MFormat::Store},
+    {"j", MFormat::Jump},     {"bnez", MFormat::Branch},
+    {"beqz", MFormat::Branch}, {"ret", MFormat::Ret},
+};
+static_assert(sizeof(kOpcodeInfo) / sizeof(kOpcodeInfo[0]) ==
+                  size_t(MOpcode::RET) + 1,
+              "kOpcodeInfo must cover every MOpcode");
+
+const std::pair<MOpcode, ImmForm> kImmForms[] = {
+    {MOpcode::ADD, {MOpcode::ADDI, true, false}},
+    {MOpcode::AND, {MOpcode::ANDI, true, false}},
+    {MOpcode::OR, {MOpcode::ORI, true, false}},
+    {MOpcode::XOR, {MOpcode::XORI, true, false}},
+    {MOpcode::SLT, {MOpcode::SLTI, false, false}},
+    {MOpcode::SLL, {MOpcode::SLLI, false, true}},
+    {MOpcode::SRL, {MOpcode::SRLI, false, true}},
+    {MOpcode::SRA, {MOpcode::SRAI, false, true}},
+    {MOpcode::SUB, {MOpcode::ADDI, false, false}},
+};
+
+}  // namespace
+
+std::string RegName(int r) {
+  if (IsVirtReg(r)) return "%v" + std::to_string(r - kFirstVirtReg);
+  assert(IsPhysReg(r));
+  return RiscVCommon::kRegNames[r];
+}
+
+const OpcodeInfo &GetOpcodeInfo(MOpcode op) { return kOpcodeInfo[int(op)]; }
+
+const ImmForm *FindImmForm(MOpcode op) {
+  for (const auto &entry : kImmForms)
+    if (entry.first == op) return &entry.second;
+  return nullptr;
+}
+
+int MachineInstr::Def() const {
+  switch (format()) {
+    case MFormat::R:
+    case MFormat::I:
+    case MFormat::Li:
+    case MFormat::Unary:
+    case MFormat::Load:
+      return rd;
+    default:
+      return kNoReg;
+  }
+}
+
+std::vector<int> MachineInstr::Uses() const {
+  switch (format()) {
+    case MFormat::R:
+    case MFormat::Store:
+      return {rs1, rs2};
+    case MFormat::I:
+    case MFormat::Unary:
+    case MFormat::Load:
+    case MFormat::Branch:
+      return {rs1};
+    case MFormat::Ret:
+      return {A0};
+    default:
+      return {};
+  }
+}
+
+void MachineInstr::ReplaceUse(int from, int to) {
+  auto f = format();
+  bool has_rs1 = f != MFormat::Li && f != MFormat::Jump && f != MFormat::Ret;
+  if (has_rs1 && rs1 == from) rs1 = to;
+  if ((f == MFormat::R || f == MFormat::Store) && rs2 == from) rs2 = to;
+}
+
+std::vector<int> MachineFunction::Successors(int b) const {
+  std::vector<int> succs;
+  const auto &insts = blocks[b].insts;
+  for (const auto &inst : insts)
+    if (inst.target >= 0) succs.push_back(inst.target);
+  bool falls = insts.empty() || (insts.back().op != MOpcode::J &&
+                                 insts.back().op != MOpcode::RET);
+  if (falls && b + 1 < int(blocks.size())) succs.push_back(b + 1);
+  return succs;
+}
+
+Liveness ComputeLiveness(const MachineFunction &mf) {
+  size_t n = mf.blocks.size();
+  std::vector<std::set<int>> gen(n), kill(n);
+  for (size_t b = 0; b < n; ++b) {
+    for (const auto &inst : mf.blocks[b].insts) {
+      for (int r : inst.Uses())
+        if (r != ZERO && !kill[b].count(r)) gen[b].insert(r);
+      if (inst.Def() != kNoReg) kill[b].insert(inst.Def());
+    }
+  }
+  Liveness live{std::vector<std::set<int>>(n), std::vector<std::set<int>>(n)};
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t b = n; b-- > 0;) {
+      std::set<int> out;
+      for (int s : mf.Successors(b))
+        out.insert(live.live_in[s].begin(), live.live_in[s].end());
+      std::set<int> in = gen[b];
+      for (int r : out)
+        if (!kill[b].count(r)) in.insert(r);
+      if (in != live.live_in[b] || out != live.live_out[b]) {
+        live.live_in[b] = std::move(in);
+        live.live_out[b] = std::move(out);
+        changed = true;
+      }
+    }
+  }
+  return live;
+}
+
+void RemoveDeadDefs(MachineFunction &mf) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::set<int> used;
+    for (const auto &block : mf.blocks)
+      for (const auto &inst : block.insts)
+        for (int r : inst.Uses()) used.insert(r);
+    for (auto &block : mf.blocks) {
+      auto dead = [&](const MachineInstr &inst) {
+        return IsVirtReg(inst.Def()) && !used.count(inst.Def());
+      };
+      auto it = std::remove_if(block.insts.begin(), block.insts.end(), dead);
+      changed |= it != block.insts.end();
+      block.insts.erase(it, block.insts.end());
+    }
+  }
+}
+
+template <class Target>
+void PrintFunction(const MachineFunction &mf, std::ostream &out) {
+  // 只有被跳转到的块才需要标签
+  std::vector<bool> targeted(mf.blocks.size(), false);
+  for (const auto &block : mf.blocks)
+    for (const auto &inst : block.insts)
+      if (inst.target >= 0) targeted[inst.target] = true;
+
+  out << "  .text\n";
+  out << "  .globl " << mf.name << "\n";
+  out << mf.name << ":\n";
+  for (size_t b = 0; b < mf.blocks.size(); ++b) {
+    if (targeted[b]) out << mf.blocks[b].label << ":\n";
+    for (const auto &inst : mf.blocks[b].insts) {
+      const auto &info = GetOpcodeInfo(inst.op);
+      const char *name = Target::Mnemonic(inst);
+      out << "  ";
+      if (info.format == MFormat::Ret) {
+        out << name << "\n";
+        continue;
+      }
+      // 助记符至少占 6 列, 更长时后面补一个空格
+      out << std::left << std::setw(std::max<int>(6, strlen(name) + 1)) << name;
+      auto addr = [&] {
+        if (inst.frame_index >= 0) return "fi#" + std::to_string(inst.frame_index);
+        return std::to_string(inst.imm) + "(" + RegName(inst.rs1) + ")";
+      };
+      switch (info.format) {
+        case MFormat::R:
+          out << RegName(inst.rd) << ", " << RegName(inst.rs1) << ", "
+              << RegName(inst.rs2);
+          break;
+        case MFormat::I:
+          out << RegName(inst.rd) << ", " << RegName(inst.rs1) << ", "
+              << inst.imm;
+          break;
+        case MFormat::Li:
+          out << RegName(inst.rd) << ", " << inst.imm;
+          break;
+        case MFormat::Unary:
+          out << RegName(inst.rd) << ", " << RegName(inst.rs1);
+          break;
+        case MFormat::Load:
+          out << RegName(inst.rd) << ", " << addr();
+          break;
+        case MFormat::Store:
+          out << RegName(inst.rs2) << ", " << addr();
+          break;
+        case MFormat::Branch:
+          out << RegName(inst.rs1) << ", " << mf.blocks[inst.target].label;
+          break;
+        case MFormat::Jump:
+          out << mf.blocks[inst.target].label;
+          break;
+        default:
+          break;
+      }
+      out << "\n";
+    }
+  }
+}
+
+template void PrintFunction<RV32>(const MachineFunction &, std::ostream &);
+template void PrintFunction<RV64>(const MachineFunction &, std::ostream &);
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// 物理寄存器, 编号与 RISC-V 的 x0 ~ x31 一致
+enum PhysReg : int {
+  ZERO, RA, SP, GP, TP, T0, T1, T2, S0, S1,
+  A0, A1, A2, A3, A4, A5, A6, A7,
+  S2, S3, S4, S5, S6, S7, S8, S9, S10, S11,
+  T3, T4, T5, T6,
+};
+
+constexpr int kNoReg = -1;
+// 虚拟寄存器从 32 开始编号
+constexpr int kFirstVirtReg = 32;
+inline bool IsVirtReg(int r) { return r >= kFirstVirtReg; }
+inline bool IsPhysReg(int r) { return r >= 0 && r < kFirstVirtReg; }
+std::string RegName(int r);
+
+enum class MOpcode : uint8_t {
+  LI, LUI, MV, SEQZ, SNEZ,
+  ADD, SUB, MUL, DIV, REM, AND, OR, XOR, SLT, SLL, SRL, SRA,
+  // Zicond
+  CZERO_EQZ, CZERO_NEZ,
+  ADDI, ANDI, ORI, XORI, SLTI, SLLI, SRLI, SRAI,
+  LW, SW,
+  // RV64 保存 / 恢复整个寄存器
+  LD, SD,
+  J, BNEZ, BEQZ, RET,
+};
+
+// 指令的操作数格式, 决定哪些字段是定值/使用以及如何打印
+enum class MFormat : uint8_t {
+  R,       // op rd, rs1, rs2
+  I,       // op rd, rs1, imm
+  Li,      // li / lui rd, imm
+  Unary,   // op rd, rs1
+  Load,    // lw rd, imm(rs1)
+  Store,   // sw rs2, imm(rs1)
+  Branch,  // op rs1, target
+  Jump,    // j target
+  Ret,     // ret (隐式使用 a0)
+};
+
+struct OpcodeInfo {
+  const char *name;
+  MFormat format;
+};
+const OpcodeInfo &GetOpcodeInfo(MOpcode op);
+
+// 寄存器运算的立即数形式: op rd, rs, r 中 r 为常量 c 时可以写成 opi rd, rs, c
+struct ImmForm {
+  MOpcode op;        // 立即数形式的操作码, sub 对应 addi 且常量取负
+  bool commutative;  // 常量在第一个操作数时也可以改写
+  bool shift;        // 立即数为移位量
+};
+// 没有立即数形式时返回 nullptr
+const ImmForm *FindImmForm(MOpcode op);
+
+struct MachineInstr {
+  MOpcode op;
+  int rd = kNoReg;
+  int rs1 = kNoReg;
+  int rs2 = kNoReg;
+  int64_t imm = 0;
+  int target = -1;       // 跳转目标块的下标
+  int frame_index = -1;  // 访存的栈上对象, 帧布局后改写为相对 sp 的偏移
+
+  MFormat format() const { return GetOpcodeInfo(op).format; }
+  bool IsTerminator() const {
+    auto f = format();
+    return f == MFormat::Branch || f == MFormat::Jump || f == MFormat::Ret;
+  }
+  // 定值的寄存器, 没有时为 kNoReg
+  int Def() const;
+  // 使用的寄存器 (含 ret 隐式使用的 a0)
+  std::vector<int> Uses() const;
+  // 把使用的寄存器 from 换成 to
+  void ReplaceUse(int from, int to);
+};
+
+struct MachineBasicBlock {
+  std::string label;
+  std::vector<MachineInstr> insts;
+};
+
+// 栈上对象: alloc 出的局部变量或溢出槽
+struct FrameObject {
+  int size = 4;
+  bool spill = false;
+  int offset = -1;  // 相对 sp 的偏移, 帧布局前为 -1
+};
+
+struct MachineFunction {
+  std::string name;
+  std::vector<MachineBasicBlock> blocks;
+  std::vector<FrameObject> frame_objects;
+  int num_vregs = 0;
+  int frame_size = 0;
+  // 用到的被调用者保存寄存器, 由帧布局在序言/尾声中保存恢复
+  std::set<int> callee_saved;
+
+  int NewVReg() { return kFirstVirtReg + num_vregs++; }
+  int NewFrameObject(int size, bool spill) {
+    frame_objects.push_back(FrameObject{size, spill});
+    return int(frame_objects.size()) - 1;
+  }
+  // 块的后继: 跳转目标以及没有无条件跳转时的下一个块
+  std::vector<int> Successors(int b) const;
+};
+
+// 块级活跃变量分析, 寄存器集合同时包含虚拟和物理寄存器
+struct Liveness {
+  std::vector<std::set<int>> live_in, live_out;
+};
+Liveness ComputeLiveness(const MachineFunction &mf);
+
+// 删除结果没有被使用的虚拟寄存器定值 (指令都没有副作用)
+void RemoveDeadDefs(MachineFunction &mf);
+
+// 输出汇编文本, Target 为 target.hpp 中的目标描述 (RV32 / RV64)
+template <class Target>
+void PrintFunction(const MachineFunction &mf, std::ostream &out);
@@ -0,0 +1,195 @@
+#include "peephole.hpp"
+#include "target.hpp"
+#include <algorithm>
+#include <set>
+
+namespace {
+
+using Insts = std::vector<MachineInstr>;
+
+bool Reads(const MachineInstr &inst, int reg) {
+  auto uses = inst.Uses();
+  return std::find(uses.begin(), uses.end(), reg) != uses.end();
+}
+
+// 从 blocks[b].insts[i] 之后开始沿所有控制流路径, reg 在被读之前都会被
+// 改写 (或函数返回) 时为死
+bool DeadAfter(const MachineFunction &mf, int b, size_t i, int reg) {
+  if (reg == ZERO || reg == SP) return false;
+  std::vector<std::pair<int, size_t>> work{{b, i + 1}};
+  std::set<int> visited;
+  while (!work.empty()) {
+    auto [cur, k] = work.back();
+    work.pop_back();
+    const auto &insts = mf.blocks[cur].insts;
+    bool killed = false;
+    for (; k < insts.size() && !killed; ++k) {
+      if (Reads(insts[k], reg)) return false;
+      killed = insts[k].Def() == reg || insts[k].op == MOpcode::RET;
+    }
+    if (killed) continue;
+    for (int s : mf.Successors(cur))
+      if (visited.insert(s).second) work.emplace_back(s, 0);
+  }
+  return true;
+}
+
+// mv x, x
+bool DropSelfMove(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  if (insts[i].rd != insts[i].rs1) return false;
+  insts.erase(insts.begin() + i);
+  return true;
+}
+
+// li r, c; op rd, rs, r  =>  opi rd, rs, c
+bool FoldLiOp(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  const auto &li = insts[i];
+  auto &inst = insts[i + 1];
+  const ImmForm *form = FindImmForm(inst.op);
+  if (!form) return false;
+  int r = li.rd, src;
+  if (inst.rs2 == r && inst.rs1 != r)
+    src = inst.rs1;
+  else if (form->commutative && inst.rs1 == r && inst.rs2 != r)
+    src = inst.rs2;
+  else
+    return false;
+  int64_t c = inst.op == MOpcode::SUB ? -li.imm : li.imm;
+  if (form->shift ? (c < 0 || c > 31) : !RiscVCommon::IsImm12(c)) return false;
+  if (inst.rd != r && !DeadAfter(mf, b, i + 1, r)) return false;
+  inst = MachineInstr{form->op, inst.rd, src, kNoReg, c};
+  insts.erase(insts.begin() + i);
+  return true;
+}
+
+// op r, ...; mv rd, r  =>  op rd, ...
+bool FoldDefMove(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  auto &def = insts[i];
+  const auto &mv = insts[i + 1];
+  if (def.Def() == kNoReg || def.Def() != mv.rs1 || mv.rd == mv.rs1 ||
+      mv.rs1 == SP || !DeadAfter(mf, b, i + 1, mv.rs1))
+    return false;
+  def.rd = mv.rd;
+  insts.erase(insts.begin() + i + 1);
+  return true;
+}
+
+// sw r, fi; ...; lw rd, fi  =>  sw r, fi; ...; mv rd, r
+bool ForwardStore(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  int r = insts[i].rs2, fi = insts[i].frame_index;
+  if (fi < 0) return false;
+  for (size_t k = i + 1; k < insts.size(); ++k) {
+    auto &inst = insts[k];
+    if (inst.op == MOpcode::LW && inst.frame_index == fi) {
+      if (inst.rd == r)
+        insts.erase(insts.begin() + k);
+      else
+        inst = MachineInstr{MOpcode::MV, inst.rd, r};
+      return true;
+    }
+    // 同一对象被改写或 r 被改写时停止; 不同栈上对象互不重叠
+    if (inst.op == MOpcode::SW && inst.frame_index == fi) return false;
+    if (inst.Def() == r || inst.IsTerminator()) return false;
+  }
+  return false;
+}
+
+// lw r, fi; sw r, fi  =>  lw r, fi
+bool DropStoreBack(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  const auto &lw = insts[i], &sw = insts[i + 1];
+  if (lw.frame_index < 0 || lw.frame_index != sw.frame_index || lw.rd != sw.rs2)
+    return false;
+  insts.erase(insts.begin() + i + 1);
+  return true;
+}
+
+// seqz/snez r, x; seqz/snez rd, r  =>  seqz/snez rd, x
+bool CollapseSetChain(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  const auto &first = insts[i];
+  auto &second = insts[i + 1];
+  int r = first.rd;
+  if (second.rs1 != r || first.rs1 == r) return false;
+  if (second.rd != r && !DeadAfter(mf, b, i + 1, r)) return false;
+  // snez 保持 0/1 结果不变, seqz 对其取反
+  MOpcode op = first.op;
+  if (second.op == MOpcode::SEQZ)
+    op = op == MOpcode::SEQZ ? MOpcode::SNEZ : MOpcode::SEQZ;
+  second = MachineInstr{op, second.rd, first.rs1};
+  insts.erase(insts.begin() + i);
+  return true;
+}
+
+// seqz/snez r, x; bnez/beqz r, L  =>  beqz/bnez x, L
+bool FoldSetBranch(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  const auto &set = insts[i];
+  auto &br = insts[i + 1];
+  if (br.rs1 != set.rd || set.rs1 == set.rd ||
+      !DeadAfter(mf, b, i + 1, set.rd))
+    return false;
+  if (set.op == MOpcode::SEQZ)
+    br.op = br.op == MOpcode::BNEZ ? MOpcode::BEQZ : MOpcode::BNEZ;
+  br.rs1 = set.rs1;
+  insts.erase(insts.begin() + i);
+  return true;
+}
+
+// 块尾跳向下一个块的 j
+bool DropJumpToNext(MachineFunction &mf, int b, size_t i) {
+  auto &insts = mf.blocks[b].insts;
+  if (i + 1 != insts.size() || insts[i].target != b + 1) return false;
+  insts.pop_back();
+  return true;
+}
+
+}  // namespace
+
+const std::vector<PeepholeRule> &PeepholeRules() {
+  static const std::vector<PeepholeRule> rules = {
+      {"drop-self-move", {{MOpcode::MV}}, DropSelfMove},
+      {"fold-li-op", {{MOpcode::LI}, {}}, FoldLiOp},
+      {"fold-def-move", {{}, {MOpcode::MV}}, FoldDefMove},
+      {"forward-store", {{MOpcode::SW}}, ForwardStore},
+      {"drop-store-back", {{MOpcode::LW}, {MOpcode::SW}}, DropStoreBack},
+      {"collapse-set-chain",
+       {{MOpcode::SEQZ, MOpcode::SNEZ}, {MOpcode::SEQZ, MOpcode::SNEZ}},
+       CollapseSetChain},
+      {"fold-set-branch",
+       {{MOpcode::SEQZ, MOpcode::SNEZ}, {MOpcode::BNEZ, MOpcode::BEQZ}},
+       FoldSetBranch},
+      {"drop-jump-to-next", {{MOpcode::J}}, DropJumpToNext},
+  };
+  return rules;
+}
+
+void Peephole(MachineFunction &mf, const std::vector<PeepholeRule> &rules) {
+  auto match = [](const std::vector<MOpcode> &ops, const MachineInstr &inst) {
+    return ops.empty() || std::find(ops.begin(), ops.end(), inst.op) != ops.end();
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int b = 0; b < int(mf.blocks.size()); ++b) {
+      auto &insts = mf.blocks[b].insts;
+      for (size_t i = 0; i < insts.size(); ++i) {
+        for (const auto &rule : rules) {
+          size_t n = rule.pattern.size();
+          if (i + n > insts.size()) continue;
+          bool ok = true;
+          for (size_t k = 0; k < n && ok; ++k)
+            ok = match(rule.pattern[k], insts[i + k]);
+          if (ok && rule.apply(mf, b, i)) {
+            changed = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+#include "mir.hpp"
+
+// 窥孔规则: pattern 为窗口内依次匹配的操作码集合, 空集合匹配任意指令;
+// 窗口匹配 blocks[b].insts[i..] 后调用 apply, 改写成功返回 true
+struct PeepholeRule {
+  const char *name;
+  std::vector<std::vector<MOpcode>> pattern;
+  bool (*apply)(MachineFunction &mf, int b, size_t i);
+};
+
+// 默认规则表
+const std::vector<PeepholeRule> &PeepholeRules();
+
+// 在寄存器分配之后、帧布局之前反复应用规则表直到不再变化
+void Peephole(MachineFunction &mf,
+              const std::vector<PeepholeRule> &rules = PeepholeRules());
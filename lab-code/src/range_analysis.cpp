@@ -0,0 +1,393 @@
+#include "range_analysis.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+constexpr int64_t kMin = INT32_MIN;
+constexpr int64_t kMax = INT32_MAX;
+// 超过该轮数后仍在变化的区间直接放宽为全集
+constexpr int kWidenRound = 3;
+constexpr int kMaxRound = 32;
+
+// 超出 32 位范围 (会回绕) 时退化为全集
+Range Clamp(int64_t lo, int64_t hi) {
+  if (lo < kMin || hi > kMax) return Range::Full();
+  return Range{lo, hi};
+}
+
+int64_t Wrap(int64_t v) {
+  return static_cast<int32_t>(static_cast<uint32_t>(v));
+}
+
+// 不小于 v 的最小 2^k - 1
+int64_t LowMask(int64_t v) {
+  int64_t m = 0;
+  while (m < v) m = m * 2 + 1;
+  return m;
+}
+
+bool IsCompare(koopa_raw_binary_op_t op) {
+  switch (op) {
+    case KOOPA_RBO_NOT_EQ:
+    case KOOPA_RBO_EQ:
+    case KOOPA_RBO_GT:
+    case KOOPA_RBO_LT:
+    case KOOPA_RBO_GE:
+    case KOOPA_RBO_LE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+koopa_raw_binary_op_t Negate(koopa_raw_binary_op_t op) {
+  switch (op) {
+    case KOOPA_RBO_NOT_EQ: return KOOPA_RBO_EQ;
+    case KOOPA_RBO_EQ: return KOOPA_RBO_NOT_EQ;
+    case KOOPA_RBO_GT: return KOOPA_RBO_LE;
+    case KOOPA_RBO_LT: return KOOPA_RBO_GE;
+    case KOOPA_RBO_GE: return KOOPA_RBO_LT;
+    case KOOPA_RBO_LE: return KOOPA_RBO_GT;
+    default: assert(false); return op;
+  }
+}
+
+// 交换操作数后的等价比较
+koopa_raw_binary_op_t Swap(koopa_raw_binary_op_t op) {
+  switch (op) {
+    case KOOPA_RBO_GT: return KOOPA_RBO_LT;
+    case KOOPA_RBO_LT: return KOOPA_RBO_GT;
+    case KOOPA_RBO_GE: return KOOPA_RBO_LE;
+    case KOOPA_RBO_LE: return KOOPA_RBO_GE;
+    default: return op;
+  }
+}
+
+Range Compare(koopa_raw_binary_op_t op, const Range &a, const Range &b) {
+  switch (op) {
+    case KOOPA_RBO_LT:
+      if (a.hi < b.lo) return Range::Const(1);
+      if (a.lo >= b.hi) return Range::Const(0);
+      return Range::Bool();
+    case KOOPA_RBO_LE:
+      if (a.hi <= b.lo) return Range::Const(1);
+      if (a.lo > b.hi) return Range::Const(0);
+      return Range::Bool();
+    case KOOPA_RBO_GT:
+      return Compare(KOOPA_RBO_LT, b, a);
+    case KOOPA_RBO_GE:
+      return Compare(KOOPA_RBO_LE, b, a);
+    case KOOPA_RBO_EQ:
+      if (a.IsConst() && b.IsConst() && a.lo == b.lo) return Range::Const(1);
+      if (a.hi < b.lo || b.hi < a.lo) return Range::Const(0);
+      return Range::Bool();
+    case KOOPA_RBO_NOT_EQ: {
+      Range r = Compare(KOOPA_RBO_EQ, a, b);
+      return r.IsConst() ? Range::Const(1 - r.lo) : r;
+    }
+    default:
+      assert(false);
+      return Range::Full();
+  }
+}
+
+// 两个常量之间的运算, 除零和 INT_MIN / -1 不折叠
+Range EvalConst(koopa_raw_binary_op_t op, int64_t a, int64_t b) {
+  uint32_t ua = static_cast<uint32_t>(a);
+  switch (op) {
+    case KOOPA_RBO_ADD: return Range::Const(Wrap(a + b));
+    case KOOPA_RBO_SUB: return Range::Const(Wrap(a - b));
+    case KOOPA_RBO_MUL: return Range::Const(Wrap(a * b));
+    case KOOPA_RBO_DIV:
+      if (b == 0 || (a == kMin && b == -1)) return Range::Full();
+      return Range::Const(a / b);
+    case KOOPA_RBO_MOD:
+      if (b == 0 || (a == kMin && b == -1)) return Range::Full();
+      return Range::Const(a % b);
+    case KOOPA_RBO_AND: return Range::Const(a & b);
+    case KOOPA_RBO_OR: return Range::Const(a | b);
+    case KOOPA_RBO_XOR: return Range::Const(a ^ b);
+    case KOOPA_RBO_SHL: return Range::Const(Wrap(ua << (b & 31)));
+    case KOOPA_RBO_SHR: return Range::Const(Wrap(ua >> (b & 31)));
+    case KOOPA_RBO_SAR: return Range::Const(a >> (b & 31));
+    default: return Compare(op, Range::Const(a), Range::Const(b));
+  }
+}
+
+}  // namespace
+
+Range Join(const Range &a, const Range &b) {
+  return Range{std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+Range Meet(const Range &a, const Range &b) {
+  return Range{std::max(a.lo, b.lo), std::min(a.hi, b.hi)};
+}
+
+Range EvalBinary(koopa_raw_binary_op_t op, const Range &a, const Range &b) {
+  if (a.IsConst() && b.IsConst()) return EvalConst(op, a.lo, b.lo);
+  if (IsCompare(op)) return Compare(op, a, b);
+  switch (op) {
+    case KOOPA_RBO_ADD:
+      return Clamp(a.lo + b.lo, a.hi + b.hi);
+    case KOOPA_RBO_SUB:
+      return Clamp(a.lo - b.hi, a.hi - b.lo);
+    case KOOPA_RBO_MUL: {
+      int64_t p[] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+      return Clamp(*std::min_element(p, p + 4), *std::max_element(p, p + 4));
+    }
+    case KOOPA_RBO_DIV: {
+      if (b.Contains(0)) return Range::Full();
+      if (a.lo == kMin && b.Contains(-1)) return Range::Full();
+      int64_t q[] = {a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi};
+      return Range{*std::min_element(q, q + 4), *std::max_element(q, q + 4)};
+    }
+    case KOOPA_RBO_MOD: {
+      if (b.Contains(0)) return Range::Full();
+      // 余数与被除数同号, 且绝对值小于除数
+      int64_t m = std::max(-b.lo, b.hi);
+      m = std::max(m, std::max(b.lo, -b.hi)) - 1;
+      if (a.NonNegative()) return Range{0, std::min(a.hi, m)};
+      if (a.hi <= 0) return Range{std::max(a.lo, -m), 0};
+      return Range{std::max(a.lo, -m), std::min(a.hi, m)};
+    }
+    case KOOPA_RBO_AND:
+      if (a.NonNegative() && b.NonNegative())
+        return Range{0, std::min(a.hi, b.hi)};
+      if (a.NonNegative()) return Range{0, a.hi};
+      if (b.NonNegative()) return Range{0, b.hi};
+      return Range::Full();
+    case KOOPA_RBO_OR:
+      if (a.NonNegative() && b.NonNegative())
+        return Range{std::max(a.lo, b.lo), LowMask(std::max(a.hi, b.hi))};
+      return Range::Full();
+    case KOOPA_RBO_XOR:
+      if (a.NonNegative() && b.NonNegative())
+        return Range{0, LowMask(std::max(a.hi, b.hi))};
+      return Range::Full();
+    case KOOPA_RBO_SHL:
+      if (b.IsConst() && b.lo >= 0 && b.lo < 32)
+        return Clamp(a.lo * (int64_t(1) << b.lo), a.hi * (int64_t(1) << b.lo));
+      return Range::Full();
+    case KOOPA_RBO_SHR:
+      if (b.IsConst() && b.lo >= 0 && b.lo < 32) {
+        if (a.NonNegative()) return Range{a.lo >> b.lo, a.hi >> b.lo};
+        if (b.lo > 0) return Range{0, int64_t(UINT32_MAX) >> b.lo};
+        return a;
+      }
+      if (a.NonNegative()) return Range{0, a.hi};
+      return Range::Full();
+    case KOOPA_RBO_SAR:
+      if (b.IsConst() && b.lo >= 0 && b.lo < 32)
+        return Range{a.lo >> b.lo, a.hi >> b.lo};
+      return Range{std::min<int64_t>(a.lo, 0), std::max<int64_t>(a.hi, 0)};
+    default:
+      return Range::Full();
+  }
+}
+
+RangeAnalysis::RangeAnalysis(koopa_raw_function_t func) {
+  if (func->bbs.len == 0) return;
+  entry_ = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]);
+  // 找出地址不逃逸的 alloc: 只作为 load 的源或 store 的目标
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      if (inst->kind.tag != KOOPA_RVT_ALLOC) continue;
+      bool tracked = inst->ty->tag == KOOPA_RTT_POINTER &&
+                     inst->ty->data.pointer.base->tag == KOOPA_RTT_INT32;
+      for (size_t k = 0; tracked && k < inst->used_by.len; ++k) {
+        auto user = reinterpret_cast<koopa_raw_value_t>(inst->used_by.buffer[k]);
+        if (user->kind.tag == KOOPA_RVT_LOAD) continue;
+        if (user->kind.tag == KOOPA_RVT_STORE &&
+            user->kind.data.store.value != inst)
+          continue;
+        tracked = false;
+      }
+      if (tracked) mem_.emplace(inst, Range{1, 0});
+    }
+  }
+
+  // 迭代到不动点, 区间只会变大, 超过一定轮数后放宽
+  bool changed = true;
+  for (int round = 0; changed && round < kMaxRound; ++round) {
+    changed = false;
+    auto update = [&](Range &slot, const Range &r, bool fresh) {
+      if (!fresh && slot == r) return;
+      Range next = (!fresh && round >= kWidenRound) ? Range::Full() : r;
+      // 已经放宽为 Full 的值不再变化, 否则永远不会收敛
+      if (!fresh && slot == next) return;
+      slot = next;
+      changed = true;
+    };
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+      auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+      for (size_t j = 0; j < bb->insts.len; ++j) {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+        const auto &kind = inst->kind;
+        switch (kind.tag) {
+          case KOOPA_RVT_BINARY:
+          case KOOPA_RVT_LOAD: {
+            Range r = Transfer(inst, bb);
+            if (r.lo > r.hi) break;  // 操作数尚未求出
+            auto it = ranges_.find(inst);
+            if (it == ranges_.end())
+              update(ranges_[inst], r, true);
+            else
+              update(it->second, r, false);
+            break;
+          }
+          case KOOPA_RVT_STORE: {
+            auto it = mem_.find(kind.data.store.dest);
+            if (it == mem_.end()) break;
+            if (!Known(kind.data.store.value)) break;
+            Range r = Get(kind.data.store.value, bb);
+            bool fresh = it->second.lo > it->second.hi;
+            update(it->second, fresh ? r : Join(it->second, r), fresh);
+            break;
+          }
+          case KOOPA_RVT_BRANCH: {
+            auto &br = kind.data.branch;
+            if (br.true_bb == br.false_bb) break;
+            Facts before_t = facts_[br.true_bb];
+            Facts before_f = facts_[br.false_bb];
+            AddEdgeFacts(br.cond, br.true_bb, true, bb);
+            AddEdgeFacts(br.cond, br.false_bb, false, bb);
+            if (facts_[br.true_bb] != before_t ||
+                facts_[br.false_bb] != before_f)
+              changed = true;
+            break;
+          }
+          case KOOPA_RVT_JUMP: {
+            auto target = kind.data.jump.target;
+            if (target->used_by.len != 1 || target == entry_) break;
+            auto it = facts_.find(bb);
+            Facts inherited = it == facts_.end() ? Facts() : it->second;
+            if (facts_[target] != inherited) {
+              facts_[target] = inherited;
+              changed = true;
+            }
+            break;
+          }
+          default:
+            break;
+        }
+      }
+    }
+  }
+  if (changed) {
+    // 未收敛, 放弃所有结论
+    ranges_.clear();
+    facts_.clear();
+    for (auto &m : mem_) m.second = Range::Full();
+  }
+}
+
+Range RangeAnalysis::Get(koopa_raw_value_t v) const {
+  if (v->kind.tag == KOOPA_RVT_INTEGER)
+    return Range::Const(v->kind.data.integer.value);
+  auto it = ranges_.find(v);
+  return it == ranges_.end() ? Range::Full() : it->second;
+}
+
+Range RangeAnalysis::Get(koopa_raw_value_t v,
+                         koopa_raw_basic_block_t bb) const {
+  Range r = Get(v);
+  auto it = facts_.find(bb);
+  if (it == facts_.end()) return r;
+  for (const auto &fact : it->second) {
+    if (fact.first != v) continue;
+    Range m = Meet(r, fact.second);
+    // 区间为空说明该块不可达, 保持原区间即可
+    return m.lo > m.hi ? r : m;
+  }
+  return r;
+}
+
+bool RangeAnalysis::GetConst(koopa_raw_value_t v, koopa_raw_basic_block_t bb,
+                             int32_t &out) const {
+  Range r = Get(v, bb);
+  if (!r.IsConst()) return false;
+  out = static_cast<int32_t>(r.lo);
+  return true;
+}
+
+// 计算 v 的区间, 操作数尚未求出时返回空区间
+Range RangeAnalysis::Transfer(koopa_raw_value_t v,
+                              koopa_raw_basic_block_t bb) const {
+  const auto &kind = v->kind;
+  if (kind.tag == KOOPA_RVT_BINARY) {
+    auto &bin = kind.data.binary;
+    if (!Known(bin.lhs) || !Known(bin.rhs)) return Range{1, 0};
+    return EvalBinary(bin.op, Get(bin.lhs, bb), Get(bin.rhs, bb));
+  }
+  if (kind.tag == KOOPA_RVT_LOAD) {
+    auto it = mem_.find(kind.data.load.src);
+    if (it == mem_.end()) return Range::Full();
+    return it->second;
+  }
+  return Range::Full();
+}
+
+// 二元运算和 load 的结果要等迭代求出后才可用
+bool RangeAnalysis::Known(koopa_raw_value_t v) const {
+  auto tag = v->kind.tag;
+  return (tag != KOOPA_RVT_BINARY && tag != KOOPA_RVT_LOAD) || ranges_.count(v);
+}
+
+// 沿 from -> target 这条边, 条件 cond 的取值为 taken
+void RangeAnalysis::AddEdgeFacts(koopa_raw_value_t cond,
+                                 koopa_raw_basic_block_t target, bool taken,
+                                 koopa_raw_basic_block_t from) {
+  auto &facts = facts_[target];
+  facts.clear();
+  // 入口块还有来自函数调用的隐含前驱
+  if (target->used_by.len != 1 || target == entry_) return;
+  auto inherited = facts_.find(from);
+  if (inherited != facts_.end() && inherited->first != target)
+    facts = inherited->second;
+  auto add = [&](koopa_raw_value_t v, Range r) {
+    if (v->kind.tag == KOOPA_RVT_INTEGER) return;
+    for (auto &fact : facts) {
+      if (fact.first == v) {
+        fact.second = Meet(fact.second, r);
+        return;
+      }
+    }
+    facts.emplace_back(v, r);
+  };
+  auto nonzero = [](Range r) {
+    if (r.lo == 0) r.lo = 1;
+    if (r.hi == 0) r.hi = -1;
+    return r;
+  };
+
+  Range c = Get(cond, from);
+  add(cond, taken ? nonzero(c) : Range::Const(0));
+  if (cond->kind.tag != KOOPA_RVT_BINARY) return;
+  auto &bin = cond->kind.data.binary;
+  if (!IsCompare(bin.op)) return;
+
+  auto op = taken ? bin.op : Negate(bin.op);
+  // 以 x op y 收窄 x
+  auto refine = [&](koopa_raw_binary_op_t op, const Range &x, const Range &y) {
+    switch (op) {
+      case KOOPA_RBO_LT: return Range{x.lo, std::min(x.hi, y.hi - 1)};
+      case KOOPA_RBO_LE: return Range{x.lo, std::min(x.hi, y.hi)};
+      case KOOPA_RBO_GT: return Range{std::max(x.lo, y.lo + 1), x.hi};
+      case KOOPA_RBO_GE: return Range{std::max(x.lo, y.lo), x.hi};
+      case KOOPA_RBO_EQ: return Meet(x, y);
+      default: {
+        Range r = x;
+        if (y.IsConst() && y.lo == r.lo) r.lo++;
+        if (y.IsConst() && y.lo == r.hi) r.hi--;
+        return r;
+      }
+    }
+  };
+  Range l = Get(bin.lhs, from), r = Get(bin.rhs, from);
+  add(bin.lhs, refine(op, l, r));
+  add(bin.rhs, refine(Swap(op), r, l));
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "koopa.h"
+
+// 有符号 32 位区间 [lo, hi], 用 int64_t 存放以便检测溢出
+struct Range {
+  int64_t lo = INT32_MIN;
+  int64_t hi = INT32_MAX;
+
+  static Range Full() { return Range(); }
+  static Range Const(int64_t v) { return Range{v, v}; }
+  static Range Bool() { return Range{0, 1}; }
+
+  bool IsConst() const { return lo == hi; }
+  bool IsFull() const { return lo == INT32_MIN && hi == INT32_MAX; }
+  bool NonNegative() const { return lo >= 0; }
+  bool Contains(int64_t v) const { return lo <= v && v <= hi; }
+  bool operator==(const Range &r) const { return lo == r.lo && hi == r.hi; }
+  bool operator!=(const Range &r) const { return !(*this == r); }
+};
+
+Range Join(const Range &a, const Range &b);
+Range Meet(const Range &a, const Range &b);
+// 二元运算的区间传递函数, 语义与 RISC-V 一致 (加减乘按 32 位回绕)
+Range EvalBinary(koopa_raw_binary_op_t op, const Range &a, const Range &b);
+
+// 函数内的区间分析:
+// - 整数常量与二元运算按传递函数计算
+// - 只被 load/store 使用的 alloc, 其 load 结果为所有 store 值的并集
+// - 条件分支的目标块若只有这一个前驱, 在块内按分支条件收窄操作数
+class RangeAnalysis {
+ public:
+  explicit RangeAnalysis(koopa_raw_function_t func);
+
+  // v 在整个函数内的区间
+  Range Get(koopa_raw_value_t v) const;
+  // v 在基本块 bb 内被使用时的区间
+  Range Get(koopa_raw_value_t v, koopa_raw_basic_block_t bb) const;
+  // v 在 bb 内是否为常量, 是则写入 out
+  bool GetConst(koopa_raw_value_t v, koopa_raw_basic_block_t bb,
+                int32_t &out) const;
+
+ private:
+  using Facts = std::vector<std::pair<koopa_raw_value_t, Range>>;
+
+  bool Known(koopa_raw_value_t v) const;
+  Range Transfer(koopa_raw_value_t v, koopa_raw_basic_block_t bb) const;
+  void AddEdgeFacts(koopa_raw_value_t cond, koopa_raw_basic_block_t target,
+                    bool taken, koopa_raw_basic_block_t from);
+
+  koopa_raw_basic_block_t entry_ = nullptr;
+  std::unordered_map<koopa_raw_value_t, Range> ranges_;
+  // alloc -> 所有 store 进去的值的区间并集
+  std::unordered_map<koopa_raw_value_t, Range> mem_;
+  std::unordered_map<koopa_raw_basic_block_t, Facts> facts_;
+};
@@ -0,0 +1,149 @@
+#include "regalloc.hpp"
+#include "target.hpp"
+#include <algorithm>
+#include <cassert>
+#include <map>
+
+namespace {
+
+using Target = RiscVCommon;
+
+struct Interval {
+  int vreg;
+  int start, end;
+};
+
+// 每个虚拟寄存器的活跃区间 [start, end]. 第 k 条指令位于 2k + 2,
+// 块的首尾位于首条指令之前 / 末条指令之后的奇数位置, 这样同一条指令
+// 最后一次使用的值与该指令的定值可以共用寄存器.
+std::vector<Interval> BuildIntervals(const MachineFunction &mf) {
+  auto live = ComputeLiveness(mf);
+  std::map<int, Interval> intervals;
+  auto extend = [&](int r, int pos) {
+    if (!IsVirtReg(r)) return;
+    auto it = intervals.find(r);
+    if (it == intervals.end()) {
+      intervals[r] = Interval{r, pos, pos};
+    } else {
+      it->second.start = std::min(it->second.start, pos);
+      it->second.end = std::max(it->second.end, pos);
+    }
+  };
+  int pos = 2;
+  for (size_t b = 0; b < mf.blocks.size(); ++b) {
+    int block_start = pos - 1;
+    for (int r : live.live_in[b]) extend(r, block_start);
+    for (const auto &inst : mf.blocks[b].insts) {
+      for (int r : inst.Uses()) extend(r, pos);
+      extend(inst.Def(), pos);
+      pos += 2;
+    }
+    int block_end = pos - 1;
+    for (int r : live.live_out[b]) extend(r, block_end);
+  }
+  std::vector<Interval> result;
+  for (auto &[r, interval] : intervals) result.push_back(interval);
+  std::sort(result.begin(), result.end(),
+            [](const Interval &a, const Interval &b) {
+              return std::tie(a.start, a.vreg) < std::tie(b.start, b.vreg);
+            });
+  return result;
+}
+
+// 溢出的虚拟寄存器: 使用前从栈上对象装入临时寄存器, 定值后写回
+void InsertSpillCode(MachineFunction &mf, const std::map<int, int> &spills) {
+  for (auto &block : mf.blocks) {
+    std::vector<MachineInstr> insts;
+    for (auto inst : block.insts) {
+      std::map<int, int> scratch;
+      for (int r : inst.Uses()) {
+        auto it = spills.find(r);
+        if (it == spills.end() || scratch.count(r)) continue;
+        assert(scratch.size() < 2);
+        int s = Target::kSpillScratch[scratch.size()];
+        scratch[r] = s;
+        insts.push_back(MachineInstr{MOpcode::LW, s, SP, kNoReg, 0, -1, it->second});
+      }
+      for (auto &[r, s] : scratch) inst.ReplaceUse(r, s);
+      int def = inst.Def();
+      auto it = spills.find(def);
+      if (it != spills.end()) {
+        inst.rd = Target::kSpillScratch[0];
+        insts.push_back(inst);
+        insts.push_back(MachineInstr{MOpcode::SW, kNoReg, SP,
+                                     Target::kSpillScratch[0], 0, -1,
+                                     it->second});
+      } else {
+        insts.push_back(inst);
+      }
+    }
+    block.insts = std::move(insts);
+  }
+}
+
+}  // namespace
+
+int AllocatableRegCount() {
+  return sizeof(Target::kAllocatable) / sizeof(Target::kAllocatable[0]);
+}
+
+void AllocateRegisters(MachineFunction &mf) {
+  auto intervals = BuildIntervals(mf);
+  std::map<int, int> assignment;  // vreg -> 物理寄存器
+  std::map<int, int> spills;      // vreg -> 溢出槽
+  const auto &allocatable = Target::kAllocatable;
+  std::vector<int> free_regs(std::rbegin(allocatable), std::rend(allocatable));
+  // 按结束位置排序的活跃区间
+  std::vector<Interval> active;
+
+  for (const auto &cur : intervals) {
+    // 结束于当前起点之前的区间归还寄存器
+    for (auto it = active.begin(); it != active.end();) {
+      if (it->end > cur.start) break;
+      free_regs.push_back(assignment[it->vreg]);
+      it = active.erase(it);
+    }
+    std::sort(free_regs.begin(), free_regs.end(), [&](int a, int b) {
+      auto rank = [&](int r) {
+        return std::find(std::begin(allocatable), std::end(allocatable), r) -
+               std::begin(allocatable);
+      };
+      return rank(a) > rank(b);
+    });
+    Interval placed = cur;
+    if (free_regs.empty()) {
+      // 没有空闲寄存器时溢出结束最晚的区间
+      auto &victim = active.back();
+      if (victim.end > cur.end) {
+        assignment[cur.vreg] = assignment[victim.vreg];
+        spills[victim.vreg] = mf.NewFrameObject(4, true);
+        assignment.erase(victim.vreg);
+        active.pop_back();
+      } else {
+        spills[cur.vreg] = mf.NewFrameObject(4, true);
+        continue;
+      }
+    } else {
+      assignment[cur.vreg] = free_regs.back();
+      free_regs.pop_back();
+    }
+    auto pos = std::upper_bound(
+        active.begin(), active.end(), placed,
+        [](const Interval &a, const Interval &b) { return a.end < b.end; });
+    active.insert(pos, placed);
+  }
+
+  InsertSpillCode(mf, spills);
+  for (auto &block : mf.blocks) {
+    for (auto &inst : block.insts) {
+      for (int r : inst.Uses())
+        if (assignment.count(r)) inst.ReplaceUse(r, assignment[r]);
+      int def = inst.Def();
+      if (IsVirtReg(def)) {
+        assert(assignment.count(def));
+        inst.rd = assignment[def];
+      }
+      if (Target::IsCalleeSaved(inst.rd)) mf.callee_saved.insert(inst.rd);
+    }
+  }
+}
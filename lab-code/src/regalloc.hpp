@@ -0,0 +1,9 @@
+#pragma once
+#include "mir.hpp"
+
+// 参与分配的物理寄存器个数
+int AllocatableRegCount();
+
+// 线性扫描寄存器分配: 把虚拟寄存器改写为物理寄存器, 分配不下的值溢出到
+// 新建的栈上对象, 每次使用前装入临时寄存器, 定值后立即写回
+void AllocateRegisters(MachineFunction &mf);
@@ -0,0 +1,170 @@
+#include "schedule.hpp"
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <set>
+#include <tuple>
+
+namespace {
+
+// 延迟取自各核公开的流水线参数, 只用于排序, 不必精确
+const CoreModel kCoreModels[] = {
+    // name          alu load mul div branch
+    {"generic",      1,  2,   3,  20, 1},
+    {"rocket",       1,  3,   4,  33, 2},
+    {"sifive-u74",   1,  3,   3,  20, 1},
+    {"c906",         1,  3,   4,  20, 2},
+};
+
+int Latency(const MachineInstr &inst, const CoreModel &core) {
+  switch (inst.op) {
+    case MOpcode::LW: return core.load_use;
+    case MOpcode::MUL: return core.mul;
+    case MOpcode::DIV:
+    case MOpcode::REM: return core.div;
+    default: return core.alu;
+  }
+}
+
+bool IsMemory(const MachineInstr &inst) {
+  return inst.op == MOpcode::LW || inst.op == MOpcode::SW;
+}
+
+void ScheduleBlock(std::vector<MachineInstr> &insts,
+                   const std::set<int> &live_out, const CoreModel &core,
+                   int max_live) {
+  size_t n = insts.size();
+  // 依赖图: succs[i] 中的 (j, lat) 表示 j 至少要在 i 发射 lat 个周期后发射
+  std::vector<std::vector<std::pair<size_t, int>>> succs(n);
+  std::vector<int> npreds(n, 0);
+  auto edge = [&](size_t from, size_t to, int lat) {
+    succs[from].emplace_back(to, lat);
+    npreds[to]++;
+  };
+  // 每个寄存器最近一次定值, 以及其后的使用
+  std::map<int, size_t> last_def;
+  std::map<int, std::vector<size_t>> uses_since_def;
+  // 块内使用次数, 以及块外定义但在块内用到的虚拟寄存器
+  std::map<int, int> local_uses;
+  std::set<int> live_in;
+  size_t first_term = n;
+  for (size_t i = 0; i < n; ++i) {
+    const auto &inst = insts[i];
+    for (int r : inst.Uses()) {
+      if (r == ZERO) continue;
+      auto it = last_def.find(r);
+      if (it != last_def.end())
+        edge(it->second, i, Latency(insts[it->second], core));
+      else if (IsVirtReg(r))
+        live_in.insert(r);
+      uses_since_def[r].push_back(i);
+      local_uses[r]++;
+    }
+    int d = inst.Def();
+    if (d != kNoReg) {
+      for (size_t u : uses_since_def[d])
+        if (u != i) edge(u, i, 0);
+      if (last_def.count(d)) edge(last_def[d], i, 0);
+      last_def[d] = i;
+      uses_since_def[d].clear();
+    }
+    // 同一栈上对象的访存保序, 两条都是 load 时除外
+    if (IsMemory(inst)) {
+      for (size_t j = 0; j < i; ++j)
+        if (IsMemory(insts[j]) && insts[j].frame_index == inst.frame_index &&
+            (inst.op == MOpcode::SW || insts[j].op == MOpcode::SW))
+          edge(j, i, insts[j].op == MOpcode::SW ? 1 : 0);
+    }
+    // 块尾的跳转依次排在所有指令之后
+    if (inst.IsTerminator()) {
+      if (first_term == n) first_term = i;
+      for (size_t j = 0; j < i; ++j)
+        if (j < first_term || j + 1 == i) edge(j, i, 0);
+    }
+  }
+
+  // 关键路径高度, 分支需要条件提前 branch 个周期算出
+  std::vector<int> height(n, 0);
+  for (size_t i = n; i-- > 0;) {
+    height[i] = insts[i].IsTerminator() ? core.branch : 1;
+    for (auto &[j, lat] : succs[i])
+      height[i] = std::max(height[i], lat + height[j]);
+  }
+
+  // 调度一条指令对活跃虚拟寄存器个数的影响
+  std::map<int, int> remaining = local_uses;
+  auto pressure_delta = [&](size_t i) {
+    int delta = 0;
+    int d = insts[i].Def();
+    if (IsVirtReg(d) && (local_uses.count(d) || live_out.count(d))) delta++;
+    auto uses = insts[i].Uses();
+    std::set<int> seen;
+    for (int r : uses) {
+      if (!IsVirtReg(r) || live_in.count(r) || live_out.count(r) ||
+          !seen.insert(r).second)
+        continue;
+      if (remaining[r] == std::count(uses.begin(), uses.end(), r)) delta--;
+    }
+    return delta;
+  };
+  int limit = std::max(1, max_live - int(live_in.size()));
+
+  std::vector<MachineInstr> order;
+  std::vector<int> ready_at(n, 0);
+  std::vector<size_t> candidates;
+  for (size_t i = 0; i < n; ++i)
+    if (npreds[i] == 0) candidates.push_back(i);
+  int cycle = 0, live = 0;
+  while (!candidates.empty()) {
+    // 依次比较: 不超过寄存器上限, 已就绪, 关键路径更长, 原始顺序靠前
+    auto key = [&](size_t i) {
+      int delta = pressure_delta(i);
+      bool fits = live + delta <= limit || delta <= 0;
+      bool ready = ready_at[i] <= cycle;
+      return std::make_tuple(!fits, fits ? 0 : delta, !ready,
+                             ready ? 0 : ready_at[i], -height[i], i);
+    };
+    auto best = std::min_element(
+        candidates.begin(), candidates.end(),
+        [&](size_t a, size_t b) { return key(a) < key(b); });
+    size_t i = *best;
+    candidates.erase(best);
+    live += pressure_delta(i);
+    for (int r : insts[i].Uses()) remaining[r]--;
+    cycle = std::max(cycle, ready_at[i]);
+    order.push_back(insts[i]);
+    for (auto &[j, lat] : succs[i]) {
+      ready_at[j] = std::max(ready_at[j], cycle + lat);
+      if (--npreds[j] == 0) candidates.push_back(j);
+    }
+    cycle++;
+  }
+  assert(order.size() == n);
+  insts = std::move(order);
+}
+
+}  // namespace
+
+const CoreModel *FindCoreModel(const std::string &name) {
+  for (const auto &m : kCoreModels)
+    if (name == m.name) return &m;
+  return nullptr;
+}
+
+const CoreModel &DefaultCoreModel() { return kCoreModels[0]; }
+
+std::string CoreModelNames() {
+  std::string names;
+  for (const auto &m : kCoreModels) {
+    if (!names.empty()) names += ", ";
+    names += m.name;
+  }
+  return names;
+}
+
+void ScheduleFunction(MachineFunction &mf, const CoreModel &core,
+                      int max_live) {
+  auto live = ComputeLiveness(mf);
+  for (size_t b = 0; b < mf.blocks.size(); ++b)
+    ScheduleBlock(mf.blocks[b].insts, live.live_out[b], core, max_live);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include "mir.hpp"
+
+// 顺序核的指令延迟表 (单位: 周期)
+struct CoreModel {
+  const char *name;
+  int alu;       // 普通整数运算
+  int load_use;  // load 结果到被使用
+  int mul;
+  int div;       // div / rem
+  int branch;    // 分支条件算出到分支可以判定
+};
+
+// 按名字查找延迟模型, 找不到返回 nullptr
+const CoreModel *FindCoreModel(const std::string &name);
+const CoreModel &DefaultCoreModel();
+// 所有模型名, 用于命令行报错提示
+std::string CoreModelNames();
+
+// 寄存器分配前的块内表调度: 按关键路径高度排序, 尽量让 load / mul / div
+// 的结果晚些再用; 活跃的虚拟寄存器超过 max_live 时优先调度能释放寄存器的指令.
+// 块尾的跳转保持在最后.
+void ScheduleFunction(MachineFunction &mf, const CoreModel &core, int max_live);
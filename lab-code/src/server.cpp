@@ -0,0 +1,224 @@
+#include "server.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "thread_pool.hpp"
+
+namespace {
+
+// 请求头中一行的长度上限
+constexpr size_t kMaxLine = 4096;
+// 客户端收到的回复体的上限, 错误的长度不至于让客户端分配失败
+constexpr size_t kMaxResponse = size_t(1) << 30;
+// 服务端读请求和写回复的超时: 连上后不发请求、或发了请求却不读回复的
+// 客户端不会一直占着工作线程, 超时后连接被关闭
+constexpr int kIoTimeoutSeconds = 30;
+
+// 对端已关闭时 send 返回错误而不是产生 SIGPIPE, 两端都能正常处理断开
+bool WriteAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+bool ReadExact(int fd, char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = read(fd, data, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+// 读一行 (不含 \n). 头部很短, 逐字节读取以免读走后面的原始字节
+bool ReadLine(int fd, std::string &line) {
+  line.clear();
+  char c;
+  while (ReadExact(fd, &c, 1)) {
+    if (c == '\n') return true;
+    if (line.size() >= kMaxLine) return false;
+    line += c;
+  }
+  return false;
+}
+
+// 解析十进制长度, 只接受数字, 溢出或超过 limit 时返回 false
+bool ParseSize(const std::string &text, size_t limit, size_t &size) {
+  if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+  errno = 0;
+  unsigned long long value = strtoull(text.c_str(), nullptr, 10);
+  if (errno == ERANGE || value > limit) return false;
+  size = size_t(value);
+  return true;
+}
+
+bool ReadSize(int fd, size_t limit, size_t &size) {
+  std::string line;
+  return ReadLine(fd, line) && ParseSize(line, limit, size);
+}
+
+bool WriteResponse(int fd, bool ok, const std::string &body) {
+  std::string head = (ok ? "ok " : "error ") + std::to_string(body.size()) + "\n";
+  return WriteAll(fd, head.data(), head.size()) &&
+         WriteAll(fd, body.data(), body.size());
+}
+
+int Connect(const std::string &path) {
+  sockaddr_un addr{};
+  if (path.size() >= sizeof(addr.sun_path)) return -1;
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 处理一个连接上的请求
+void HandleConnection(const ServerOptions &opts, int fd) {
+  size_t argc;
+  std::vector<std::string> args;
+  bool ok = ReadSize(fd, 64, argc);
+  for (size_t i = 0; ok && i < argc; ++i) {
+    args.emplace_back();
+    ok = ReadLine(fd, args.back());
+  }
+  size_t len = 0;
+  SourceBuffer src;
+  ok = ok && ReadSize(fd, opts.max_source_size, len);
+  if (ok) ok = ReadExact(fd, src.Allocate(len), len);
+  if (!ok || args.empty()) {
+    WriteResponse(fd, false, "malformed request\n");
+    return;
+  }
+
+  CompileOptions compile_opts;
+  compile_opts.cache = opts.cache;
+  compile_opts.incremental = opts.incremental;
+  if (args[0] == "-koopa") {
+    compile_opts.output = OutputKind::Koopa;
+  } else if (args[0] != "-riscv") {
+    WriteResponse(fd, false, "unknown mode '" + args[0] + "'\n");
+    return;
+  }
+  for (size_t i = 1; i < args.size(); ++i) {
+    std::string error;
+    if (!ParseBackendOption(args[i], compile_opts.backend, error)) {
+      WriteResponse(fd, false, error + "\n");
+      return;
+    }
+  }
+  StringSink sink;
+  if (compile(src, compile_opts, sink)) {
+    WriteResponse(fd, true, sink.output);
+    return;
+  }
+  std::string errors;
+  for (const auto &e : sink.errors) errors += e + "\n";
+  WriteResponse(fd, false, errors);
+}
+
+}  // namespace
+
+int RunServer(const ServerOptions &opts, std::ostream &err) {
+  sockaddr_un addr{};
+  if (opts.socket_path.size() >= sizeof(addr.sun_path)) {
+    err << "socket path too long: " << opts.socket_path << "\n";
+    return 1;
+  }
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, opts.socket_path.c_str());
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    err << "socket: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  // 删除上次运行遗留的 socket 文件; 若仍有服务在监听则不抢占
+  int probe = Connect(opts.socket_path);
+  if (probe >= 0) {
+    close(probe);
+    close(listener);
+    err << "a server is already listening on " << opts.socket_path << "\n";
+    return 1;
+  }
+  unlink(opts.socket_path.c_str());
+  if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    err << "cannot listen on " << opts.socket_path << ": "
+        << std::strerror(errno) << "\n";
+    close(listener);
+    return 1;
+  }
+
+  ThreadPool pool(opts.jobs);
+  for (;;) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      err << "accept: " << std::strerror(errno) << "\n";
+      break;
+    }
+    timeval timeout{kIoTimeoutSeconds, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    pool.Submit([&opts, fd] {
+      HandleConnection(opts, fd);
+      close(fd);
+    });
+  }
+  close(listener);
+  unlink(opts.socket_path.c_str());
+  return 1;
+}
+
+bool CompileRemote(const std::string &socket_path,
+                   const std::vector<std::string> &args, const char *src,
+                   size_t src_len, StringSink &result, bool &ok) {
+  int fd = Connect(socket_path);
+  if (fd < 0) return false;
+  std::string head = std::to_string(args.size()) + "\n";
+  for (const auto &arg : args) head += arg + "\n";
+  head += std::to_string(src_len) + "\n";
+  std::string status, body;
+  size_t len = 0;
+  bool sent = WriteAll(fd, head.data(), head.size()) &&
+              WriteAll(fd, src, src_len);
+  bool received = sent && ReadLine(fd, status);
+  size_t space = status.find(' ');
+  received = received && space != std::string::npos &&
+             ParseSize(status.substr(space + 1), kMaxResponse, len);
+  if (received) {
+    body.resize(len);
+    received = ReadExact(fd, &body[0], len);
+  }
+  close(fd);
+  // 服务中途断开也按连不上处理, 由调用方在本进程内重新编译
+  if (!received) return false;
+  ok = status.compare(0, space, "ok") == 0;
+  if (ok) {
+    result.output = std::move(body);
+  } else {
+    size_t start = 0, end;
+    while ((end = body.find('\n', start)) != std::string::npos) {
+      result.errors.push_back(body.substr(start, end - start));
+      start = end + 1;
+    }
+  }
+  return true;
+}
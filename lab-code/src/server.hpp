@@ -0,0 +1,29 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "sysyc.hpp"
+
+// 常驻编译服务: 在 Unix domain socket 上接受编译请求, 用线程池并发处理.
+//
+// 每个连接一个请求, 请求和响应都是若干文本行后跟原始字节:
+//   请求: <参数个数>\n  <参数>\n ...  <源码长度>\n <源码>
+//         参数与命令行相同, 第一个为 -koopa 或 -riscv
+//   响应: ok <长度>\n <输出>   或   error <长度>\n <诊断, 每行一条>
+struct ServerOptions {
+  std::string socket_path;
+  int jobs = 1;
+  size_t max_source_size = size_t(64) << 20;
+  // 非空时所有请求共用这个编译缓存
+  const CompileCache *cache = nullptr;
+  bool incremental = false;
+};
+
+// 运行服务, 只在无法建立 socket 时返回非 0
+int RunServer(const ServerOptions &opts, std::ostream &err);
+
+// 客户端: 把一次编译发给 socket_path 上的服务. 连不上服务时返回 false,
+// 调用方应回退到进程内编译; 否则 ok 为编译是否成功, 结果在 result 中
+bool CompileRemote(const std::string &socket_path,
+                   const std::vector<std::string> &args, const char *src,
+                   size_t src_len, StringSink &result, bool &ok);
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// SHA-256 (FIPS 180-4), 用于编译缓存的键
+class Sha256 {
+ public:
+  Sha256();
+  void Update(const void *data, size_t len);
+  void Update(const std::string &s) { Update(s.data(), s.size()); }
+  // 结束并返回 64 个字符的十六进制摘要, 之后不能再 Update
+  std::string HexDigest();
+
+ private:
+  void Compress(const uint8_t *block);
+
+  uint32_t state_[8];
+  uint8_t buffer_[64];
+  size_t buffered_ = 0;
+  uint64_t length_ = 0;  // 已输入的字节数
+};
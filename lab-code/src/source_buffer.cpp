@@ -0,0 +1,105 @@
+#include "source_buffer.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::~SourceBuffer() { Release(); }
+
+void SourceBuffer::Release() {
+  if (mapped_) munmap(data_, mapped_);
+  mapped_ = 0;
+  copy_.clear();
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool SourceBuffer::Map(const std::string &path, std::string &error) {
+  Release();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = std::string("cannot open input file: ") + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    // 管道等不能映射, 读到内存里
+    bool ok = ReadFrom(fd, SIZE_MAX, error);
+    close(fd);
+    return ok;
+  }
+
+  // 先占一段匿名的零页, 再把文件映射到它的开头: 文件末页超出文件长度
+  // 的部分和之后的匿名页都是 '\0', 正好作为 flex 要求的结尾标记
+  size_t len = size_t(st.st_size);
+  size_t page = size_t(sysconf(_SC_PAGESIZE));
+  size_t total = (len + kPadding + page - 1) / page * page;
+  void *base = mmap(nullptr, total, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base != MAP_FAILED && len > 0 &&
+      mmap(base, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+          MAP_FAILED) {
+    munmap(base, total);
+    base = MAP_FAILED;
+  }
+  int saved_errno = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    error = std::string("cannot map input file: ") + strerror(saved_errno);
+    return false;
+  }
+  data_ = static_cast<char *>(base);
+  size_ = len;
+  mapped_ = total;
+  return true;
+}
+
+bool SourceBuffer::Read(const std::string &path, size_t limit,
+                        std::string &error) {
+  Release();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = std::string("cannot open input file: ") + strerror(errno);
+    return false;
+  }
+  bool ok = ReadFrom(fd, limit, error);
+  close(fd);
+  return ok;
+}
+
+bool SourceBuffer::ReadFrom(int fd, size_t limit, std::string &error) {
+  std::vector<char> content;
+  char chunk[65536];
+  ssize_t n;
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+    if (size_t(n) > limit - content.size()) {
+      error = "input file is larger than " + std::to_string(limit) + " bytes";
+      return false;
+    }
+    content.insert(content.end(), chunk, chunk + n);
+  }
+  if (n < 0) {
+    error = std::string("cannot read input file: ") + strerror(errno);
+    return false;
+  }
+  size_ = content.size();
+  content.resize(size_ + kPadding, '\0');
+  copy_ = std::move(content);
+  data_ = copy_.data();
+  return true;
+}
+
+void SourceBuffer::Assign(const char *src, size_t len) {
+  memcpy(Allocate(len), src, len);
+}
+
+char *SourceBuffer::Allocate(size_t len) {
+  Release();
+  copy_.assign(len + kPadding, '\0');
+  data_ = copy_.data();
+  size_ = len;
+  return data_;
+}
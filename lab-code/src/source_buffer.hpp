@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 源程序缓冲区: 内容之后总有 kPadding 个 '\0', flex 的 yy_scan_buffer 可以
+// 直接在上面扫描, 不必再复制一份. 扫描时 flex 会临时改写缓冲区, 所以是可写的
+class SourceBuffer {
+ public:
+  static constexpr size_t kPadding = 2;
+
+  SourceBuffer() = default;
+  ~SourceBuffer();
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+  // 把文件 path 私有映射到内存; 不是普通文件时退回到读入内存.
+  // 失败时返回 false, error 中是不含路径的原因.
+  // 映射期间文件被其他进程截断时, 访问超出新长度的页会收到 SIGBUS,
+  // 所以只在单文件编译时使用; 批量编译用 Read, 一个文件出问题不影响其他文件
+  bool Map(const std::string &path, std::string &error);
+  // 把文件 path 读入内存, 超过 limit 字节时失败
+  bool Read(const std::string &path, size_t limit, std::string &error);
+  // 复制 src[0, len)
+  void Assign(const char *src, size_t len);
+  // 分配 len 字节由调用方填写, 返回其起始地址
+  char *Allocate(size_t len);
+
+  char *data() { return data_; }
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  void Release();
+  bool ReadFrom(int fd, size_t limit, std::string &error);
+
+  char *data_ = nullptr;
+  size_t size_ = 0;
+  // mmap 的长度, 为 0 时内容在 copy_ 中
+  size_t mapped_ = 0;
+  std::vector<char> copy_;
+};
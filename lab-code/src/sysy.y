@@ -3,7 +3,13 @@
   #include <string>
   #include <cassert>
   #include "AST.hpp"
-  #include "sysy.tab.hpp"
+  #include "frontend.hpp"
+
+  // 与 flex 生成的 reentrant scanner 共用的句柄类型
+  #ifndef YY_TYPEDEF_YY_SCANNER_T
+  #define YY_TYPEDEF_YY_SCANNER_T
+  typedef void *yyscan_t;
+  #endif
 }
 
 %{
@@ -14,68 +20,87 @@
 #include "AST.hpp"
 #include <string>
 
+#include "sysy.tab.hpp"
+
 // 声明 lexer 函数和错误处理函数
-int yylex();
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s);
+int yylex(YYSTYPE *lvalp, yyscan_t scanner);
+void yyerror(yyscan_t scanner, ParseContext &ctx, const char *s);
 
 using namespace std;
 
 %}
 
-// 定义 parser 函数和错误处理函数的附加参数
-%parse-param { std::unique_ptr<BaseAST> &ast }
+// 生成可重入的 parser, 状态都在参数里
+%define api.pure full
+
+// 定义 parser 函数和错误处理函数的附加参数: scanner 句柄和解析上下文
+%lex-param { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { ParseContext &ctx }
 
 // yylval 的定义
 %union {
-  std::string *str_val;
+  TokenText text_val;
+  const char *op_val;
   int int_val;
   BaseAST *ast_val;
 }
 
 // token 声明，补充所有双字符运算符
 %token INT RETURN
-%token <str_val> IDENT
+%token <text_val> IDENT
 %token <int_val> INT_CONST
 %token LE GE EQ NE AND OR
 
 // 非终结符的类型定义
 %type <ast_val> FuncDef FuncType Block Stmt Number Exp PrimaryExp UnaryExp MulExp AddExp RelExp EqExp LAndExp LOrExp
-%type <str_val> UnaryOp
+%type <op_val> UnaryOp
 %%
 
-// 开始符, CompUnit ::= FuncDef, 大括号后声明了解析完成后 parser 要做的事情
-// 之前我们定义了 FuncDef 会返回一个 str_val, 也就是字符串指针
+// 开始符, CompUnit ::= FuncDef {FuncDef}, 大括号后声明了解析完成后 parser 要做的事情
+// FuncDefList 归约时把函数定义按出现顺序收集在 ctx.func_defs 中, 本身没有值,
+// 这样语法错误时也没有需要释放的中间结果
 // 而 parser 一旦解析完 CompUnit, 就说明所有的 token 都被解析了, 即解析结束了
-// 此时我们应该把 FuncDef 返回的结果收集起来, 作为 AST 传给调用 parser 的函数
-// $1 指代规则里第一个符号的返回值, 也就是 FuncDef 的返回值
+// 此时我们应该把收集到的函数定义放进 arena, 作为 AST 传给调用 parser 的函数
 CompUnit
+  : FuncDefList {
+    ctx.Trace() << "[CompUnit] FuncDef ok\n";
+    auto comp_unit = ctx.arena.New<CompUnitAST>();
+    comp_unit->func_defs = ctx.arena.CopyArray(ctx.func_defs);
+    ctx.ast = comp_unit;
+  }
+  ;
+
+// 流式编译时 FuncDef 一归约完就交给 ctx.on_func_def, 列表保持为空
+FuncDefList
   : FuncDef {
     assert($1 != nullptr);
-    std::cerr << "[CompUnit] FuncDef ok\n";
-    auto comp_unit = make_unique<CompUnitAST>();
-    comp_unit->func_def = unique_ptr<BaseAST>($1);
-    ast = move(comp_unit);
+    if (!ctx.AddFuncDef($1)) YYABORT;
+  }
+  | FuncDefList FuncDef {
+    assert($2 != nullptr);
+    if (!ctx.AddFuncDef($2)) YYABORT;
   }
   ;
 
 FuncDef
   : FuncType IDENT '(' ')' Block {
     assert($1 != nullptr);
-    assert($2 != nullptr);
+    assert($2.ptr != nullptr);
     assert($5 != nullptr);
-    std::cerr << "[FuncDef] FuncType, IDENT, Block ok\n";
-    auto ast = new FuncDefAST();
-    ast->func_type = unique_ptr<BaseAST>($1);
-    ast->ident = *unique_ptr<string>($2);
-    ast->block = unique_ptr<BaseAST>($5);
+    ctx.Trace() << "[FuncDef] FuncType, IDENT, Block ok\n";
+    auto ast = ctx.arena.New<FuncDefAST>();
+    ast->func_type = $1;
+    // 直接指向源程序缓冲区, 它比 AST 活得久; 流式编译重置 arena 也不影响
+    ast->ident = $2.view();
+    ast->block = $5;
     $$ = ast;
   }
   ;
 
 FuncType
   : INT {
-    std::cerr << "[FuncType] INT ok\n";
-    auto ast = new FuncTypeAST();
+    ctx.Trace() << "[FuncType] INT ok\n";
+    auto ast = ctx.arena.New<FuncTypeAST>();
     ast->type = "int";
     $$ = ast;
   }
@@ -84,9 +109,9 @@ FuncType
 Block
   : '{' Stmt '}' {
     assert($2 != nullptr);
-    std::cerr << "[Block] Stmt ok\n";
-    auto ast = new BlockAST();
-    ast->stmt = unique_ptr<BaseAST>($2);
+    ctx.Trace() << "[Block] Stmt ok\n";
+    auto ast = ctx.arena.New<BlockAST>();
+    ast->stmt = $2;
     $$ = ast;
   }
   ;
@@ -94,9 +119,9 @@ Block
 Stmt
   : RETURN Exp ';' {
     assert($2 != nullptr);
-    std::cerr << "[Stmt] Exp ok\n";
-    auto ast = new StmtAST();
-    ast->stmt = unique_ptr<BaseAST>($2);
+    ctx.Trace() << "[Stmt] Exp ok\n";
+    auto ast = ctx.arena.New<StmtAST>();
+    ast->stmt = $2;
     $$ = ast;
   }
   ;
@@ -104,9 +129,9 @@ Stmt
 Exp
   : LOrExp { 
     assert($1 != nullptr);
-    std::cerr << "[Exp] LOrExp ok\n";
-    auto ast = new ExpAST(); 
-    ast->lor_exp = std::unique_ptr<BaseAST>($1); 
+    ctx.Trace() << "[Exp] LOrExp ok\n";
+    auto ast = ctx.arena.New<ExpAST>(); 
+    ast->lor_exp = $1; 
     $$ = ast;
   }
   ;
@@ -114,16 +139,16 @@ Exp
 PrimaryExp
   : '(' Exp ')' { 
       assert($2 != nullptr);
-      std::cerr << "[PrimaryExp] (Exp) ok\n";
-      auto ast = new PrimaryExpAST(); 
+      ctx.Trace() << "[PrimaryExp] (Exp) ok\n";
+      auto ast = ctx.arena.New<PrimaryExpAST>(); 
       ast->is_number = false; 
-      ast->exp = std::unique_ptr<BaseAST>($2); 
+      ast->exp = $2; 
       $$ = ast; 
     }
   | Number { 
       assert($1 != nullptr);
-      std::cerr << "[PrimaryExp] Number ok\n";
-      auto ast = new PrimaryExpAST(); 
+      ctx.Trace() << "[PrimaryExp] Number ok\n";
+      auto ast = ctx.arena.New<PrimaryExpAST>(); 
       ast->is_number = true; 
       ast->number_value = dynamic_cast<NumberAST*>($1)->value; 
       $$ = ast; 
@@ -132,8 +157,8 @@ PrimaryExp
 
 Number
   : INT_CONST { 
-      std::cerr << "[Number] INT_CONST=" << $1 << "\n";
-      auto ast = new NumberAST(); 
+      ctx.Trace() << "[Number] INT_CONST=" << $1 << "\n";
+      auto ast = ctx.arena.New<NumberAST>(); 
       ast->value = $1; 
       $$ = ast; 
     }
@@ -142,60 +167,59 @@ Number
 UnaryExp
   : PrimaryExp { 
       assert($1 != nullptr);
-      std::cerr << "[UnaryExp] PrimaryExp ok\n";
+      ctx.Trace() << "[UnaryExp] PrimaryExp ok\n";
       $$ = $1; 
     }
   | UnaryOp UnaryExp { 
-      assert($1 != nullptr);
       assert($2 != nullptr);
-      std::cerr << "[UnaryExp] UnaryOp=" << *$1 << " UnaryExp ok\n";
-      auto ast = new UnaryExpAST(); 
-      ast->op = *$1; 
-      ast->exp = std::unique_ptr<BaseAST>($2); 
+      ctx.Trace() << "[UnaryExp] UnaryOp=" << $1 << " UnaryExp ok\n";
+      auto ast = ctx.arena.New<UnaryExpAST>(); 
+      ast->op = $1; 
+      ast->exp = $2; 
       $$ = ast; 
     }
   ;
 
 UnaryOp
-  : '+' { std::cerr << "[UnaryOp] +\n"; $$ = new std::string("+"); }
-  | '-' { std::cerr << "[UnaryOp] -\n"; $$ = new std::string("-"); }
-  | '!' { std::cerr << "[UnaryOp] !\n"; $$ = new std::string("!"); }
+  : '+' { ctx.Trace() << "[UnaryOp] +\n"; $$ = "+"; }
+  | '-' { ctx.Trace() << "[UnaryOp] -\n"; $$ = "-"; }
+  | '!' { ctx.Trace() << "[UnaryOp] !\n"; $$ = "!"; }
   ;
 
 MulExp
   : UnaryExp { 
       assert($1 != nullptr);
-      std::cerr << "[MulExp] UnaryExp ok\n";
+      ctx.Trace() << "[MulExp] UnaryExp ok\n";
       $$ = $1; 
     }
   | MulExp '*' UnaryExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[MulExp] *\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[MulExp] *\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "*"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   | MulExp '/' UnaryExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[MulExp] /\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[MulExp] /\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "/"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   | MulExp '%' UnaryExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[MulExp] %\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[MulExp] %\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "%"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   ;
@@ -203,27 +227,27 @@ MulExp
 AddExp
   : MulExp { 
       assert($1 != nullptr);
-      std::cerr << "[AddExp] MulExp ok\n";
+      ctx.Trace() << "[AddExp] MulExp ok\n";
       $$ = $1; 
     }
   | AddExp '+' MulExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[AddExp] +\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[AddExp] +\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "+"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   | AddExp '-' MulExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[AddExp] -\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[AddExp] -\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "-"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   ;
@@ -231,47 +255,47 @@ AddExp
 RelExp
   : AddExp { 
       assert($1 != nullptr);
-      std::cerr << "[RelExp] AddExp ok\n";
+      ctx.Trace() << "[RelExp] AddExp ok\n";
       $$ = $1; 
     }
   | RelExp '<' AddExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[RelExp] <\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[RelExp] <\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "<"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   | RelExp '>' AddExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[RelExp] >\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[RelExp] >\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = ">"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   | RelExp LE AddExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[RelExp] <=\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[RelExp] <=\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "<="; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   | RelExp GE AddExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[RelExp] >=\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[RelExp] >=\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = ">="; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   ;
@@ -279,27 +303,27 @@ RelExp
 EqExp
   : RelExp { 
       assert($1 != nullptr);
-      std::cerr << "[EqExp] RelExp ok\n";
+      ctx.Trace() << "[EqExp] RelExp ok\n";
       $$ = $1; 
     }
   | EqExp EQ RelExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[EqExp] ==\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[EqExp] ==\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "=="; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   | EqExp NE RelExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[EqExp] !=\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[EqExp] !=\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "!="; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   ;
@@ -307,17 +331,17 @@ EqExp
 LAndExp
   : EqExp { 
       assert($1 != nullptr);
-      std::cerr << "[LAndExp] EqExp ok\n";
+      ctx.Trace() << "[LAndExp] EqExp ok\n";
       $$ = $1; 
     }
   | LAndExp AND EqExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[LAndExp] &&\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[LAndExp] &&\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "&&"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   ;
@@ -325,23 +349,23 @@ LAndExp
 LOrExp
   : LAndExp { 
       assert($1 != nullptr);
-      std::cerr << "[LOrExp] LAndExp ok\n";
+      ctx.Trace() << "[LOrExp] LAndExp ok\n";
       $$ = $1; 
     }
   | LOrExp OR LAndExp { 
       assert($1 != nullptr);
       assert($3 != nullptr);
-      std::cerr << "[LOrExp] ||\n";
-      auto ast = new BinaryExpAST(); 
+      ctx.Trace() << "[LOrExp] ||\n";
+      auto ast = ctx.arena.New<BinaryExpAST>(); 
       ast->op = "||"; 
-      ast->lhs = std::unique_ptr<BaseAST>($1); 
-      ast->rhs = std::unique_ptr<BaseAST>($3); 
+      ast->lhs = $1; 
+      ast->rhs = $3; 
       $$ = ast; 
     }
   ;
 
 %%
 
-void yyerror(unique_ptr<BaseAST> &ast, const char *s) {
-  cerr << "error: " << s << endl;
+void yyerror(yyscan_t scanner, ParseContext &ctx, const char *s) {
+  ctx.errors.push_back(s);
 }
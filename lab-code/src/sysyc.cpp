@@ -0,0 +1,229 @@
+#include "sysyc.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <set>
+#include <sstream>
+#include "compile_cache.hpp"
+#include "frontend.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+// 每种输出各一份的字符串: 生成的代码, 或者它们的缓存键
+struct Output {
+  std::string koopa, riscv;
+};
+
+// 本次编译要生成的输出及其去向, 为空表示不需要
+struct Targets {
+  OutputSink *koopa = nullptr;
+  OutputSink *riscv = nullptr;
+};
+
+CompileOptions WithOutput(const CompileOptions &opts, OutputKind kind) {
+  CompileOptions copy = opts;
+  copy.output = kind;
+  return copy;
+}
+
+// 按需要的输出查缓存, 全部命中才返回 true
+bool Lookup(const CompileCache &cache, const Output &keys,
+            const Targets &targets, Output &out) {
+  return (!targets.koopa || cache.Lookup(keys.koopa, out.koopa)) &&
+         (!targets.riscv || cache.Lookup(keys.riscv, out.riscv));
+}
+
+void Insert(const CompileCache &cache, const Output &keys,
+            const Targets &targets, const Output &out) {
+  if (targets.koopa) cache.Insert(keys.koopa, out.koopa);
+  if (targets.riscv) cache.Insert(keys.riscv, out.riscv);
+}
+
+void Write(const Targets &targets, const Output &out) {
+  if (targets.koopa) targets.koopa->Write(out.koopa);
+  if (targets.riscv) targets.riscv->Write(out.riscv);
+}
+
+// 单个函数的输出片段. 函数之间没有调用和全局变量, 各自单独翻译.
+// RISC-V 由同一份 Koopa IR 生成
+Output EmitFunction(const BaseAST &func_def, const Targets &targets,
+                    const BackendOptions &backend) {
+  Output out;
+  KoopaContext koopa;
+  out.koopa = func_def.EmitKoopa(koopa);
+  if (targets.riscv) {
+    std::ostringstream riscv;
+    deal_koopa(out.koopa.c_str(), riscv, backend);
+    out.riscv = riscv.str();
+  }
+  return out;
+}
+
+// 增量编译时的片段: 以函数 AST 的规范文本为键查缓存.
+// 语言支持函数调用和全局变量后, 键还要包含被调函数的签名和引用的全局变量
+Output EmitFunctionCached(const BaseAST &func_def, const Targets &targets,
+                          const CompileOptions &opts) {
+  std::ostringstream text;
+  func_def.Dump(text);
+  Output keys, out;
+  if (targets.koopa)
+    keys.koopa = opts.cache->FragmentKey(
+        text.str(), WithOutput(opts, OutputKind::Koopa));
+  if (targets.riscv)
+    keys.riscv = opts.cache->FragmentKey(
+        text.str(), WithOutput(opts, OutputKind::RiscV));
+  if (Lookup(*opts.cache, keys, targets, out)) return out;
+  out = EmitFunction(func_def, targets, opts.backend);
+  Insert(*opts.cache, keys, targets, out);
+  return out;
+}
+
+}  // namespace
+
+bool ParseBackendOption(const std::string &arg, BackendOptions &opts,
+                        std::string &error) {
+  if (arg.rfind("-mtune=", 0) == 0) {
+    opts.core = FindCoreModel(arg.substr(7));
+    if (!opts.core)
+      error = "unknown -mtune core '" + arg.substr(7) +
+              "', expected one of: " + CoreModelNames();
+    return opts.core != nullptr;
+  }
+  if (arg.rfind("-march=", 0) == 0) {
+    std::string reason;
+    if (ParseMarch(arg.substr(7), opts.features, reason)) return true;
+    error = "invalid -march '" + arg.substr(7) + "': " + reason;
+    return false;
+  }
+  if (arg.rfind("-backend-jobs=", 0) == 0) {
+    opts.jobs = atoi(arg.c_str() + 14);
+    if (opts.jobs <= 0) error = "invalid -backend-jobs '" + arg.substr(14) + "'";
+    return opts.jobs > 0;
+  }
+  error = "unknown option '" + arg + "'";
+  return false;
+}
+
+bool compile(const char *src, size_t len, const CompileOptions &opts,
+             OutputSink &sink) {
+  SourceBuffer buffer;
+  buffer.Assign(src, len);
+  return compile(buffer, opts, sink);
+}
+
+bool compile(SourceBuffer &src, const CompileOptions &opts, OutputSink &sink) {
+  Targets targets;
+  if (opts.output == OutputKind::Koopa) {
+    targets.koopa = &sink;
+  } else {
+    targets.riscv = &sink;
+    targets.koopa = opts.koopa_sink;
+  }
+
+  Output keys, output;
+  if (opts.cache) {
+    if (targets.koopa)
+      keys.koopa = opts.cache->Key(src.data(), src.size(),
+                                   WithOutput(opts, OutputKind::Koopa));
+    if (targets.riscv)
+      keys.riscv = opts.cache->Key(src.data(), src.size(),
+                                   WithOutput(opts, OutputKind::RiscV));
+    // AST 和归约过程只能在解析时输出, 需要它们时不走整个程序的缓存,
+    // 保证输出与是否命中无关
+    bool needs_parse = opts.ast_dump || opts.trace;
+    if (!needs_parse && Lookup(*opts.cache, keys, targets, output)) {
+      Write(targets, output);
+      return true;
+    }
+  }
+
+  ParseContext parse;
+  parse.trace = opts.trace;
+  std::set<std::string> names;
+  auto define = [&](const BaseAST &func_def) {
+    std::string name(static_cast<const FuncDefAST &>(func_def).ident);
+    if (names.insert(name).second) return true;
+    parse.errors.push_back("redefinition of function '" + name + "'");
+    return false;
+  };
+  bool incremental = opts.incremental && opts.cache;
+  // 后端无法处理时抛出异常, 这里转成该函数的错误, 不让它逃出工作线程
+  auto emit = [&](const BaseAST &func_def, Output &out, std::string &error) {
+    try {
+      out = incremental ? EmitFunctionCached(func_def, targets, opts)
+                        : EmitFunction(func_def, targets, opts.backend);
+      return true;
+    } catch (const std::exception &e) {
+      error = e.what();
+      return false;
+    }
+  };
+  // 把第 i 个函数的片段接到 to 后面, Koopa IR 的函数之间空一行
+  auto append = [](Output &to, const Output &fragment, size_t i) {
+    if (i > 0) to.koopa += "\n";
+    to.koopa += fragment.koopa;
+    to.riscv += fragment.riscv;
+  };
+
+  // 流式编译: 每个函数归约完成就生成代码并写出, 随后释放它的 AST
+  size_t streamed = 0;
+  if (opts.streaming) {
+    parse.on_func_def = [&](const BaseAST &func_def) {
+      if (opts.ast_dump) func_def.Dump(*opts.ast_dump);
+      if (!define(func_def)) return false;
+      Output code, fragment;
+      std::string error;
+      if (!emit(func_def, code, error)) {
+        parse.errors.push_back(error);
+        return false;
+      }
+      append(fragment, code, streamed);
+      if (opts.cache) append(output, fragment, 0);
+      Write(targets, fragment);
+      ++streamed;
+      return true;
+    };
+  }
+
+  bool ok = ParseSource(src, parse);
+  const auto *unit = static_cast<const CompUnitAST *>(parse.ast);
+  if (ok && !opts.streaming) {
+    if (opts.ast_dump) unit->Dump(*opts.ast_dump);
+    for (const auto &func_def : unit->func_defs)
+      if (!(ok = define(*func_def))) break;
+  }
+  if (!ok) {
+    for (const auto &error : parse.errors) sink.Error(error);
+    if (parse.errors.empty()) sink.Error("syntax error");
+    return false;
+  }
+
+  if (!opts.streaming) {
+    // 各函数的片段可以并行生成, 按出现顺序拼接
+    size_t n = unit->func_defs.size();
+    std::vector<Output> fragments(n);
+    std::vector<std::string> errors(n);
+    auto emit_at = [&](size_t i) {
+      emit(*unit->func_defs[i], fragments[i], errors[i]);
+    };
+    if (opts.backend.jobs > 1 && n > 1) {
+      ThreadPool pool(int(std::min<size_t>(opts.backend.jobs, n)));
+      for (size_t i = 0; i < n; ++i) pool.Submit([&, i] { emit_at(i); });
+      pool.Wait();
+    } else {
+      for (size_t i = 0; i < n; ++i) emit_at(i);
+    }
+    bool failed = false;
+    for (const auto &error : errors) {
+      if (error.empty()) continue;
+      sink.Error(error);
+      failed = true;
+    }
+    if (failed) return false;
+    for (size_t i = 0; i < n; ++i) append(output, fragments[i], i);
+    Write(targets, output);
+  }
+  if (opts.cache) Insert(*opts.cache, keys, targets, output);
+  return true;
+}
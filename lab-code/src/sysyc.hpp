@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "koopaIR2RISC-V.hpp"
+#include "source_buffer.hpp"
+
+// libsysyc: 把 SysY 源程序编译为 Koopa IR 或 RISC-V 汇编.
+// 每次调用的状态 (scanner, parser, IR 生成) 都在调用内部, 没有全局变量,
+// 可以在同一进程的多个线程中同时编译.
+
+enum class OutputKind { Koopa, RiscV };
+
+class CompileCache;
+class OutputSink;
+
+struct CompileOptions {
+  OutputKind output = OutputKind::RiscV;
+  BackendOptions backend;
+  // 非空时输出 parser 每条规则的归约过程
+  std::ostream *trace = nullptr;
+  // 非空时输出解析得到的 AST
+  std::ostream *ast_dump = nullptr;
+  // 非空时先查编译缓存, 命中则不再解析; 未命中时把成功的输出写入缓存.
+  // 要求 trace 或 ast_dump 时总是解析, 只有 incremental 的函数片段可以命中
+  const CompileCache *cache = nullptr;
+  // 增量编译: 整个程序未命中缓存时, 按函数查缓存, 只重新生成改动过的函数
+  bool incremental = false;
+  // 流式编译: 每个函数解析完就生成代码并写入 OutputSink, 内存只与最大的
+  // 函数有关. 遇到错误时, 之前的函数已经写出
+  bool streaming = false;
+  // output 为 RiscV 时, 非空则用同一次解析生成的 Koopa IR 同时写入这里
+  OutputSink *koopa_sink = nullptr;
+};
+
+// 编译结果的去向
+class OutputSink {
+ public:
+  virtual ~OutputSink() = default;
+  // 生成的代码, 一次编译可能分多次写入
+  virtual void Write(const std::string &text) = 0;
+  // 一条诊断信息
+  virtual void Error(const std::string &message) = 0;
+};
+
+// 写入 std::ostream 的 OutputSink
+class StreamSink : public OutputSink {
+ public:
+  StreamSink(std::ostream &out, std::ostream &err) : out_(out), err_(err) {}
+  void Write(const std::string &text) override { out_ << text; }
+  void Error(const std::string &message) override {
+    err_ << "error: " << message << "\n";
+  }
+
+ private:
+  std::ostream &out_;
+  std::ostream &err_;
+};
+
+// 把输出和诊断收集到内存中的 OutputSink
+class StringSink : public OutputSink {
+ public:
+  void Write(const std::string &text) override { output += text; }
+  void Error(const std::string &message) override { errors.push_back(message); }
+
+  std::string output;
+  std::vector<std::string> errors;
+};
+
+// 解析一个 -mtune= / -march= / -backend-jobs= 选项, 失败或不认识时返回 false 并写入 error
+bool ParseBackendOption(const std::string &arg, BackendOptions &opts,
+                        std::string &error);
+
+// 编译 src[0, len), 成功返回 true; 失败时通过 sink.Error 报告原因
+bool compile(const char *src, size_t len, const CompileOptions &opts,
+             OutputSink &sink);
+// 同上, 直接在 src 上扫描, 不复制源程序
+bool compile(SourceBuffer &src, const CompileOptions &opts, OutputSink &sink);
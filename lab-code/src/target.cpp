@@ -0,0 +1,62 @@
+#include "target.hpp"
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+struct Extension {
+  const char *name;
+  bool TargetFeatures::*flag;  // 后端不使用的扩展为 nullptr
+};
+
+const Extension kExtensions[] = {
+    {"zbb", &TargetFeatures::zbb},
+    {"zicond", &TargetFeatures::zicond},
+    {"zicsr", nullptr},
+    {"zifencei", nullptr},
+    {"zba", nullptr},
+    {"zbs", nullptr},
+};
+
+// 后端只生成 I / M 指令, 其余单字母扩展仅接受.
+// v 也只接受: 源语言没有数组, 没有可向量化的循环
+const char kSingleLetter[] = "imafdcgv";
+
+}  // namespace
+
+bool ParseMarch(const std::string &march, TargetFeatures &features,
+                std::string &error) {
+  TargetFeatures result;
+  if (march.compare(0, 4, "rv32") == 0) {
+    result.xlen = 32;
+  } else if (march.compare(0, 4, "rv64") == 0) {
+    result.xlen = 64;
+  } else {
+    error = "expected rv32 or rv64";
+    return false;
+  }
+  size_t pos = 4;
+  // 单字母扩展直到第一个多字母扩展 (z 开头) 或下划线为止
+  while (pos < march.size() && march[pos] != '_' && march[pos] != 'z') {
+    if (!std::strchr(kSingleLetter, march[pos])) {
+      error = std::string("unsupported extension '") + march[pos] + "'";
+      return false;
+    }
+    ++pos;
+  }
+  std::stringstream rest(march.substr(pos));
+  std::string ext;
+  while (std::getline(rest, ext, '_')) {
+    if (ext.empty()) continue;
+    const Extension *found = nullptr;
+    for (const auto &e : kExtensions)
+      if (ext == e.name) found = &e;
+    if (!found) {
+      error = "unsupported extension '" + ext + "'";
+      return false;
+    }
+    if (found->flag) result.*(found->flag) = true;
+  }
+  features = result;
+  return true;
+}
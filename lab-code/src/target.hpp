@@ -0,0 +1,86 @@
+#pragma once
+#include <string>
+#include "mir.hpp"
+
+// 目标可选扩展, 对应 -march 中的扩展名
+struct TargetFeatures {
+  int xlen = 32;        // 通用寄存器宽度, 由 rv32 / rv64 前缀决定
+  bool zbb = false;     // 位操作基础扩展, 可以指定但目前不生成其中的指令
+  bool zicond = false;  // 条件置零: czero.eqz / czero.nez
+};
+
+// 解析 -march 字符串, 例如 rv32im_zbb_zicond. 失败时返回 false 并写入 error
+bool ParseMarch(const std::string &march, TargetFeatures &features,
+                std::string &error);
+
+// RV32 和 RV64 相同的部分: 寄存器文件、调用约定 (ilp32 / lp64) 和立即数范围.
+// 寄存器分配和常量处理不区分宽度, 直接使用这里的描述.
+struct RiscVCommon {
+  // 按 x0 ~ x31 编号排列的 ABI 名
+  static constexpr const char *kRegNames[] = {
+      "x0", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0",
+      "a1", "a2", "a3", "a4", "a5", "a6", "a7", "s2", "s3", "s4", "s5",
+      "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+  };
+  // 分配顺序: 先用调用者保存的寄存器, 不够再用需要在序言中保存的 s 寄存器.
+  // a0 留给返回值, t5 / t6 留给溢出代码和大偏移寻址.
+  static constexpr int kAllocatable[] = {
+      T0, T1, T2, T3, T4, A1, A2, A3, A4, A5, A6, A7,
+      S1, S2, S3, S4, S5, S6, S7, S8, S9, S10, S11,
+  };
+  // 溢出值装入/写回时使用的临时寄存器, 不参与分配
+  static constexpr int kSpillScratch[] = {T5, T6};
+
+  static constexpr bool IsCalleeSaved(int r) {
+    return r == S0 || r == S1 || (r >= S2 && r <= S11);
+  }
+
+  // I 型指令和访存偏移的有符号 12 位立即数
+  static constexpr int64_t kImmMin = -2048;
+  static constexpr int64_t kImmMax = 2047;
+  static constexpr bool IsImm12(int64_t v) {
+    return v >= kImmMin && v <= kImmMax;
+  }
+};
+
+// 编译期目标描述. 在 RiscVCommon 之上, 区别只在寄存器宽度: RV64 上 int
+// 运算用 *w 指令保持结果符号扩展, 被调用者保存寄存器要整宽保存.
+template <int XLen>
+struct RiscVTarget : RiscVCommon {
+  static_assert(XLen == 32 || XLen == 64, "XLEN must be 32 or 64");
+  static constexpr int kXLen = XLen;
+  static constexpr int kRegBytes = XLen / 8;
+  // 保存 / 恢复整个寄存器的访存指令
+  static constexpr MOpcode kSaveOp = XLen == 64 ? MOpcode::SD : MOpcode::SW;
+  static constexpr MOpcode kRestoreOp = XLen == 64 ? MOpcode::LD : MOpcode::LW;
+
+  // 32 位运算在 RV64 上的写法, 没有 w 形式的指令返回 nullptr
+  static constexpr const char *WordName(MOpcode op) {
+    if (XLen == 32) return nullptr;
+    switch (op) {
+      case MOpcode::ADD: return "addw";
+      case MOpcode::SUB: return "subw";
+      case MOpcode::MUL: return "mulw";
+      case MOpcode::DIV: return "divw";
+      case MOpcode::REM: return "remw";
+      case MOpcode::SLL: return "sllw";
+      case MOpcode::SRL: return "srlw";
+      case MOpcode::SRA: return "sraw";
+      case MOpcode::ADDI: return "addiw";
+      case MOpcode::SLLI: return "slliw";
+      case MOpcode::SRLI: return "srliw";
+      case MOpcode::SRAI: return "sraiw";
+      default: return nullptr;
+    }
+  }
+
+  // 指令的助记符. 以 sp 为操作数的是地址运算, 总用整宽指令
+  static const char *Mnemonic(const MachineInstr &inst) {
+    const char *word = WordName(inst.op);
+    if (word && inst.rd != SP && inst.rs1 != SP && inst.rs2 != SP) return word;
+    return GetOpcodeInfo(inst.op).name;
+  }
+};
+
+using RV32 = RiscVTarget<32>;
+using RV64 = RiscVTarget<64>;
@@ -0,0 +1,76 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) {
+  size_t n = std::max(threads, 1);
+  for (size_t i = 0; i < n; ++i) queues_.push_back(std::make_unique<Queue>());
+  for (size_t i = 0; i < n; ++i) workers_.emplace_back([this, i] { WorkerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto &worker : workers_) worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  // 先计数再入队, 任务被取走或完成时计数不会减到负数
+  size_t q;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    q = next_queue_++ % queues_.size();
+    ++queued_;
+    ++pending_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+    queues_[q]->tasks.push_back(std::move(task));
+  }
+  work_cv_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool ThreadPool::TryPop(size_t self, std::function<void()> &task) {
+  // 先取自己队尾的任务, 再按顺序窃取其他队列队首的任务
+  for (size_t k = 0; k < queues_.size(); ++k) {
+    auto &queue = *queues_[(self + k) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    if (k == 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(size_t self) {
+  for (;;) {
+    std::function<void()> task;
+    if (TryPop(self, task)) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --queued_;
+      }
+      task();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--pending_ == 0) done_cv_.notify_all();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_ && queued_ == 0) return;
+  }
+}
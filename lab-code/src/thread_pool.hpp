@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 工作窃取线程池: 每个工作线程有自己的任务队列, 从队尾取任务;
+// 自己的队列为空时从其他线程的队首窃取, 长短不一的任务也能均衡分摊
+class ThreadPool {
+ public:
+  explicit ThreadPool(int threads);
+  // 等待已提交的任务全部完成后结束工作线程
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void Submit(std::function<void()> task);
+  // 阻塞直到已提交的任务全部完成
+  void Wait();
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  bool TryPop(size_t self, std::function<void()> &task);
+  void WorkerLoop(size_t self);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  size_t queued_ = 0;   // 在队列中尚未取出的任务数
+  size_t pending_ = 0;  // 已提交尚未完成的任务数
+  size_t next_queue_ = 0;
+  bool stop_ = false;
+};